@@ -0,0 +1,209 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+static float surface_area(BVH::Box const &box) {
+	if (box.empty()) return 0.0f;
+	glm::vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static BVH::Box box_union(BVH::Box const &a, BVH::Box const &b) {
+	BVH::Box ret;
+	ret.min = glm::min(a.min, b.min);
+	ret.max = glm::max(a.max, b.max);
+	return ret;
+}
+
+void BVH::build(std::vector< Box > const &boxes) {
+	nodes.clear();
+	root = -1U;
+	item_leaf.assign(boxes.size(), -1U);
+	cost = 0.0f;
+
+	std::vector< uint32_t > items;
+	items.reserve(boxes.size());
+	for (uint32_t i = 0; i < boxes.size(); ++i) {
+		if (!boxes[i].empty()) items.emplace_back(i);
+	}
+	if (items.empty()) {
+		built_cost = 0.0f;
+		return;
+	}
+
+	nodes.reserve(2 * items.size() - 1);
+	root = build_range(items, 0, uint32_t(items.size()), boxes, -1U);
+	built_cost = cost;
+}
+
+uint32_t BVH::build_range(std::vector< uint32_t > &items, uint32_t begin, uint32_t end, std::vector< Box > const &boxes, uint32_t parent) {
+	assert(begin < end);
+
+	uint32_t index = uint32_t(nodes.size());
+	nodes.emplace_back();
+	nodes[index].parent = parent;
+
+	if (end - begin == 1) {
+		nodes[index].item = items[begin];
+		nodes[index].box = boxes[items[begin]];
+		item_leaf[items[begin]] = index;
+		return index;
+	}
+
+	//split at the median along the axis where item centers are most spread out:
+	Box centers;
+	for (uint32_t i = begin; i < end; ++i) {
+		glm::vec3 center = 0.5f * (boxes[items[i]].min + boxes[items[i]].max);
+		centers.min = glm::min(centers.min, center);
+		centers.max = glm::max(centers.max, center);
+	}
+	glm::vec3 spread = centers.max - centers.min;
+	uint32_t axis = 0;
+	if (spread.y > spread[axis]) axis = 1;
+	if (spread.z > spread[axis]) axis = 2;
+
+	uint32_t mid = begin + (end - begin) / 2;
+	std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end, [&boxes,axis](uint32_t a, uint32_t b) {
+		return boxes[a].min[axis] + boxes[a].max[axis] < boxes[b].min[axis] + boxes[b].max[axis];
+	});
+
+	uint32_t left = build_range(items, begin, mid, boxes, index);
+	uint32_t right = build_range(items, mid, end, boxes, index);
+	//(n.b. 'nodes' may have been reallocated, so index again)
+	nodes[index].left = left;
+	nodes[index].right = right;
+	nodes[index].box = box_union(nodes[left].box, nodes[right].box);
+	cost += surface_area(nodes[index].box);
+	return index;
+}
+
+void BVH::refit(uint32_t item, Box const &box) {
+	assert(item < item_leaf.size());
+	uint32_t leaf = item_leaf[item];
+	assert(leaf != -1U && "can only refit items that were in the tree when it was built");
+	assert(!box.empty());
+
+	nodes[leaf].box = box;
+
+	//re-compute ancestors' boxes until one doesn't change:
+	for (uint32_t at = nodes[leaf].parent; at != -1U; at = nodes[at].parent) {
+		Node &node = nodes[at];
+		Box updated = box_union(nodes[node.left].box, nodes[node.right].box);
+		if (updated.min == node.box.min && updated.max == node.box.max) break;
+		cost += surface_area(updated) - surface_area(node.box);
+		node.box = updated;
+	}
+}
+
+bool BVH::needs_rebuild() const {
+	return cost > 1.5f * built_cost;
+}
+
+void BVH::query_frustum(glm::mat4 const &world_to_clip, std::function< void(uint32_t) > const &fn) const {
+	if (root == -1U) return;
+
+	//frustum planes from rows of the clip matrix (see Scene::box_in_frustum):
+	glm::vec4 planes[6];
+	glm::mat4 rows = glm::transpose(world_to_clip);
+	for (uint32_t i = 0; i < 3; ++i) {
+		planes[2*i+0] = rows[3] + rows[i];
+		planes[2*i+1] = rows[3] - rows[i];
+	}
+
+	//(nodes entirely inside the frustum are pushed with InsideBit set, so nothing below them is tested)
+	std::vector< uint32_t > &stack = frustum_stack;
+	stack.assign(1, root);
+	while (!stack.empty()) {
+		uint32_t index = stack.back() & ~InsideBit;
+		bool inside = (stack.back() & InsideBit) != 0;
+		stack.pop_back();
+		Node const &node = nodes[index];
+
+		if (!inside) {
+			glm::vec3 center = 0.5f * (node.box.max + node.box.min);
+			glm::vec3 radius = 0.5f * (node.box.max - node.box.min);
+			bool outside = false;
+			inside = true;
+			for (auto const &plane : planes) {
+				float dist = glm::dot(glm::vec3(plane), center) + plane.w;
+				float extent = glm::dot(glm::abs(glm::vec3(plane)), radius);
+				if (dist + extent < 0.0f) { outside = true; break; }
+				if (dist - extent < 0.0f) inside = false;
+			}
+			if (outside) continue;
+		}
+
+		if (node.item != -1U) {
+			fn(node.item);
+		} else {
+			stack.emplace_back(node.left | (inside ? InsideBit : 0U));
+			stack.emplace_back(node.right | (inside ? InsideBit : 0U));
+		}
+	}
+}
+
+void BVH::query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< void(uint32_t) > const &fn) const {
+	if (root == -1U) return;
+
+	std::vector< uint32_t > stack;
+	stack.emplace_back(root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.box.max.x < min.x || node.box.min.x > max.x) continue;
+		if (node.box.max.y < min.y || node.box.min.y > max.y) continue;
+		if (node.box.max.z < min.z || node.box.min.z > max.z) continue;
+
+		if (node.item != -1U) {
+			fn(node.item);
+		} else {
+			stack.emplace_back(node.left);
+			stack.emplace_back(node.right);
+		}
+	}
+}
+
+void BVH::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t,
+	std::function< float(uint32_t, float) > const &fn) const {
+	if (root == -1U) return;
+
+	//slab test; n.b. division by zero gives +/- infinity, which the min/max below handle:
+	glm::vec3 inv_dir = 1.0f / direction;
+	auto enter_t = [&](Box const &box) -> float {
+		glm::vec3 t0 = (box.min - origin) * inv_dir;
+		glm::vec3 t1 = (box.max - origin) * inv_dir;
+		glm::vec3 near = glm::min(t0, t1);
+		glm::vec3 far = glm::max(t0, t1);
+		float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float exit = std::min(std::min(far.x, far.y), std::min(far.z, max_t));
+		return (enter <= exit ? enter : std::numeric_limits< float >::infinity());
+	};
+
+	std::vector< uint32_t > stack;
+	stack.emplace_back(root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		stack.pop_back();
+
+		float t = enter_t(node.box);
+		if (!(t <= max_t)) continue;
+
+		if (node.item != -1U) {
+			max_t = std::min(max_t, fn(node.item, t));
+		} else {
+			//visit nearer child first, so shortened rays prune more:
+			float t_left = enter_t(nodes[node.left].box);
+			float t_right = enter_t(nodes[node.right].box);
+			if (t_left < t_right) {
+				if (t_right <= max_t) stack.emplace_back(node.right);
+				if (t_left <= max_t) stack.emplace_back(node.left);
+			} else {
+				if (t_left <= max_t) stack.emplace_back(node.left);
+				if (t_right <= max_t) stack.emplace_back(node.right);
+			}
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+ * A BVH is a bounding volume hierarchy over a set of axis-aligned boxes ("items",
+ *  named by index), used to find the items in a view frustum, box, or along a ray
+ *  without testing every item.
+ *
+ * Items that move can be refit in place (which only touches the path from their
+ *  leaf to the root); since refitting slowly makes the tree worse, 'needs_rebuild()'
+ *  reports when a full build() would pay off.
+ *
+ * Scene keeps one of these over its drawables (see Scene::update_drawable_bvh()).
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+struct BVH {
+	struct Box {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		bool empty() const { return !(min.x <= max.x && min.y <= max.y && min.z <= max.z); }
+	};
+
+	//(re-)build the tree over boxes[0 .. boxes.size()-1]; empty boxes are left out of the tree:
+	void build(std::vector< Box > const &boxes);
+
+	//change the box of an item that was part of the last build():
+	// (the item must not have been empty at build time)
+	void refit(uint32_t item, Box const &box);
+
+	//true when refitting has made the tree noticeably worse than it was when built:
+	bool needs_rebuild() const;
+
+	//call 'fn' with each item whose box might be inside the frustum of 'world_to_clip':
+	// (uses 'frustum_stack' as working storage, so it doesn't allocate once warmed up -- and mustn't run on two threads at once)
+	void query_frustum(glm::mat4 const &world_to_clip, std::function< void(uint32_t) > const &fn) const;
+
+	//call 'fn' with each item whose box overlaps [min,max]:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< void(uint32_t) > const &fn) const;
+
+	//call 'fn' with each item whose box is hit by the ray origin + t * direction, t in [0,max_t]:
+	// 'fn' is given the t at which the ray enters the box; it may return a smaller max_t to shorten
+	// the ray (e.g., to find the nearest hit), or max_t to keep going.
+	void query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t,
+		std::function< float(uint32_t, float) > const &fn) const;
+
+	bool empty() const { return root == -1U; }
+	uint32_t size() const { return uint32_t(item_leaf.size()); } //(items, including ones left out of the tree)
+
+	//-- internals --
+	struct Node {
+		Box box;
+		uint32_t parent = -1U;
+		uint32_t left = -1U, right = -1U; //children, for internal nodes
+		uint32_t item = -1U; //item, for leaves
+	};
+	std::vector< Node > nodes;
+	uint32_t root = -1U;
+	std::vector< uint32_t > item_leaf; //item -> leaf node (or -1U if not in tree)
+
+	//tree quality is measured as the total surface area of internal nodes:
+	float cost = 0.0f;
+	float built_cost = 0.0f;
+
+	//scratch for query_frustum(): nodes still to visit, with InsideBit set on ones known to be entirely in view:
+	enum : uint32_t { InsideBit = 0x80000000U };
+	mutable std::vector< uint32_t > frustum_stack;
+
+	uint32_t build_range(std::vector< uint32_t > &items, uint32_t begin, uint32_t end, std::vector< Box > const &boxes, uint32_t parent);
+};
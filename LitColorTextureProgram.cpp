@@ -2,6 +2,7 @@
 
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "gl_state.hpp"
 
 Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
 
@@ -11,30 +12,23 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	//----- build the pipeline template -----
 	lit_color_texture_program_pipeline.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	//matrices come from the "Object" uniform block:
+	lit_color_texture_program_pipeline.object_uniform_block = true;
 
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	//(light parameters come from the "Frame" uniform block -- see Scene::frame_uniforms)
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
 	glGenTextures(1, &tex);
 
-	glBindTexture(GL_TEXTURE_2D, tex);
+	gl_state.bind_texture(0, GL_TEXTURE_2D, tex);
 	std::vector< glm::u8vec4 > tex_data(1, glm::u8vec4(0xff));
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex_data.data());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_state.bind_texture(0, GL_TEXTURE_2D, 0);
 
 
 	lit_color_texture_program_pipeline.textures[0].texture = tex;
@@ -43,14 +37,52 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+Load< LitColorTextureProgram > lit_color_texture_program_instanced(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(true);
+
+	//used when drawing several copies of a mesh at once (the vao comes from MeshBuffer::make_instanced_vao_for_program):
+	lit_color_texture_program_pipeline.instanced.program = ret->program;
+
+	return ret;
+});
+
+//per-frame camera and light parameters, shared by all programs (see Scene::FrameUniforms):
+static char const *FrameBlock =
+	"layout(std140) uniform Frame {\n"
+	"	mat4 WORLD_TO_CLIP;\n"
+	"	mat4x3 WORLD_TO_LIGHT;\n"
+	"	vec3 LIGHT_LOCATION;\n"
+	"	int LIGHT_TYPE;\n"
+	"	vec3 LIGHT_DIRECTION;\n"
+	"	float LIGHT_CUTOFF;\n"
+	"	vec3 LIGHT_ENERGY;\n"
+	"	uvec4 CLUSTER_COUNTS;\n"
+	"	vec4 CLUSTER_TILE;\n"
+	"	vec4 CLUSTER_DEPTH;\n"
+	"};\n";
+
+LitColorTextureProgram::LitColorTextureProgram(bool instanced) {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		std::string("#version 330\n")
+		+ FrameBlock
+		+ (instanced ?
+			//per-instance matrices come from attributes (see Scene::InstanceData):
+			"in mat4 INSTANCE_OBJECT_TO_CLIP;\n"
+			"in mat4x3 INSTANCE_OBJECT_TO_LIGHT;\n"
+			"in mat3 INSTANCE_NORMAL_TO_LIGHT;\n"
+			"#define OBJECT_TO_CLIP INSTANCE_OBJECT_TO_CLIP\n"
+			"#define OBJECT_TO_LIGHT INSTANCE_OBJECT_TO_LIGHT\n"
+			"#define NORMAL_TO_LIGHT INSTANCE_NORMAL_TO_LIGHT\n"
+		:
+			//per-object matrices come from a uniform block (see Scene::ObjectUniforms):
+			"layout(std140) uniform Object {\n"
+			"	mat4 OBJECT_TO_CLIP;\n"
+			"	mat4x3 OBJECT_TO_LIGHT;\n"
+			"	mat3 NORMAL_TO_LIGHT;\n"
+			"};\n"
+		) +
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -68,13 +100,13 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"}\n"
 	,
 		//fragment shader:
-		"#version 330\n"
+		std::string("#version 330\n")
+		+ FrameBlock +
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
+		//clustered point/spot lights (see LightClusters):
+		"uniform samplerBuffer LIGHTS;\n"
+		"uniform usamplerBuffer CLUSTERS;\n"
+		"uniform usamplerBuffer CLUSTER_LIGHTS;\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
@@ -102,6 +134,28 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
 		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
 		"	}\n"
+		"	if (CLUSTER_COUNTS.z != 0u) { //add lights from this fragment's cluster:\n"
+		"		ivec3 c = ivec3(floor(vec3((gl_FragCoord.xy - CLUSTER_TILE.zw) * CLUSTER_TILE.xy, log(1.0 / gl_FragCoord.w) * CLUSTER_DEPTH.x + CLUSTER_DEPTH.y)));\n"
+		"		c = clamp(c, ivec3(0), ivec3(CLUSTER_COUNTS.xyz) - 1);\n"
+		"		uvec2 range = texelFetch(CLUSTERS, (c.z * int(CLUSTER_COUNTS.y) + c.y) * int(CLUSTER_COUNTS.x) + c.x).xy;\n"
+		"		for (uint i = range.x; i < range.x + range.y; ++i) {\n"
+		"			int l = 3 * int(texelFetch(CLUSTER_LIGHTS, int(i)).x);\n"
+		"			vec4 position_radius = texelFetch(LIGHTS, l);\n"
+		"			vec4 energy_type = texelFetch(LIGHTS, l+1);\n"
+		"			vec3 to_light = position_radius.xyz - position;\n"
+		"			float dis2 = dot(to_light,to_light);\n"
+		"			vec3 dir = to_light * inversesqrt(max(dis2, 1e-8));\n"
+		"			float nl = max(0.0, dot(n, dir)) / max(1.0, dis2);\n"
+		"			float f = dis2 / (position_radius.w * position_radius.w);\n"
+		"			nl *= clamp(1.0 - f * f, 0.0, 1.0); //fade to zero at the light's radius\n"
+		"			if (energy_type.w == 2.0) { //spot light \n"
+		"				vec4 direction_cutoff = texelFetch(LIGHTS, l+2);\n"
+		"				float c = dot(dir,-direction_cutoff.xyz);\n"
+		"				nl *= smoothstep(direction_cutoff.w,mix(direction_cutoff.w,1.0,0.1), c);\n"
+		"			}\n"
+		"			e += nl * energy_type.rgb;\n"
+		"		}\n"
+		"	}\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
 		"}\n"
@@ -120,21 +174,29 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
 
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
-
+	//attach uniform blocks to Scene's binding points:
+	// (n.b. blocks the program doesn't use are optimized out; glGetUniformBlockIndex returns GL_INVALID_INDEX for those)
+	GLuint Frame_block = glGetUniformBlockIndex(program, "Frame");
+	if (Frame_block != GL_INVALID_INDEX) glUniformBlockBinding(program, Frame_block, Scene::FrameUniformBinding);
+	GLuint Object_block = glGetUniformBlockIndex(program, "Object");
+	if (Object_block != GL_INVALID_INDEX) glUniformBlockBinding(program, Object_block, Scene::ObjectUniformBinding);
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	GLuint LIGHTS_samplerBuffer = glGetUniformLocation(program, "LIGHTS");
+	GLuint CLUSTERS_usamplerBuffer = glGetUniformLocation(program, "CLUSTERS");
+	GLuint CLUSTER_LIGHTS_usamplerBuffer = glGetUniformLocation(program, "CLUSTER_LIGHTS");
 
 	//set TEX to always refer to texture binding zero:
-	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
+	gl_state.use_program(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
 
-	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
+	//cluster buffers are bound by Scene::draw to these units:
+	glUniform1i(LIGHTS_samplerBuffer, LightClusters::LightsTextureUnit);
+	glUniform1i(CLUSTERS_usamplerBuffer, LightClusters::ClustersTextureUnit);
+	glUniform1i(CLUSTER_LIGHTS_usamplerBuffer, LightClusters::ClusterLightsTextureUnit);
+
+	gl_state.use_program(0); //unbind program -- glUniform* calls refer to ??? now
 }
 
 LitColorTextureProgram::~LitColorTextureProgram() {
@@ -6,7 +6,9 @@
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	//if 'instanced' is set, the OBJECT_TO_* / NORMAL_TO_* matrices are per-instance attributes
+	// (INSTANCE_OBJECT_TO_CLIP, etc; see Scene::InstanceData) instead of uniforms:
+	explicit LitColorTextureProgram(bool instanced = false);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
@@ -18,23 +20,24 @@ struct LitColorTextureProgram {
 	GLuint TexCoord_vec2 = -1U;
 
 	//Uniform (per-invocation variable) locations:
+	// (-1U: matrices come from per-instance attributes or from the "Object" uniform block, see Scene::ObjectUniforms)
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
 
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
+	//Uniform blocks:
+	//"Frame" - camera and lighting (see Scene::FrameUniforms), bound to Scene::FrameUniformBinding
+	//"Object" - matrices (see Scene::ObjectUniforms), bound to Scene::ObjectUniformBinding (non-instanced variant only)
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+	//TEXTURE4..6 - clustered light buffers (see LightClusters; bound by Scene::draw)
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+extern Load< LitColorTextureProgram > lit_color_texture_program_instanced;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: instanced.program is set, but you'll need to supply instanced.vao to enable instancing.
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
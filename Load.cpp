@@ -2,31 +2,89 @@
 
 #include <array>
 #include <list>
+#include <future>
+#include <chrono>
 #include <cassert>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
+	//each load function either runs entirely on the main thread ('fn'),
+	// or starts on a worker thread ('background_fn') and finishes with the function it returns:
+	struct LoadFunction {
+		std::function< void() > fn;
+		std::function< std::function< void() >() > background_fn;
+		std::future< std::function< void() > > background; //(valid once started)
+	};
+
+	std::array< std::list< LoadFunction >, MaxLoadTag > &get_load_lists() {
+		static std::array< std::list< LoadFunction >, MaxLoadTag > load_lists;
 		return load_lists;
 	}
+
+	uint32_t load_total = 0;
+	uint32_t load_done = 0;
 }
 
 void add_load_function(LoadTag tag, std::function< void() > const &fn) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	load_lists[tag].emplace_back();
+	load_lists[tag].back().fn = fn;
+	load_total += 1;
+}
+
+void add_background_load_function(LoadTag tag, std::function< std::function< void() >() > const &background_fn) {
+	auto &load_lists = get_load_lists();
+	assert(tag < load_lists.size());
+	load_lists[tag].emplace_back();
+	load_lists[tag].back().background_fn = background_fn;
+	load_total += 1;
 }
 
-void call_load_functions() {
+void call_load_functions(std::function< void(uint32_t done, uint32_t total) > const &on_progress) {
+	start_load_functions();
+	while (!poll_load_functions(on_progress)) {
+		//wait for the next background function to finish:
+		for (auto &fn_list : get_load_lists()) {
+			if (!fn_list.empty()) {
+				if (fn_list.front().background.valid()) fn_list.front().background.wait();
+				break;
+			}
+		}
+	}
+}
+
+void start_load_functions() {
 	static bool has_been_called = false;
-	assert(!has_been_called && "call_load_functions should only be called *once*");
+	assert(!has_been_called && "start_load_functions (or call_load_functions) should only be called *once*");
 	has_been_called = true;
 
+	for (auto &fn_list : get_load_lists()) {
+		for (auto &load : fn_list) {
+			if (load.background_fn) {
+				load.background = std::async(std::launch::async, load.background_fn);
+			}
+		}
+	}
+}
+
+bool poll_load_functions(std::function< void(uint32_t done, uint32_t total) > const &on_progress) {
 	auto &load_lists = get_load_lists();
 	for (auto &fn_list : load_lists) {
 		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
+			LoadFunction &load = *fn_list.begin(); //first function in the list
+			if (load.background.valid()) {
+				//stop here if the background part is still running (later functions may depend on this one):
+				if (load.background.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+				load.background.get()(); //finish on this thread (re-throws if background part threw)
+			} else {
+				assert(load.fn && "background functions are started by start_load_functions");
+				load.fn();
+			}
 			fn_list.pop_front(); //remove from list
+
+			load_done += 1;
+			if (on_progress) on_progress(load_done, load_total);
 		}
 	}
+	return true;
 }
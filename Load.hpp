@@ -20,10 +20,23 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Slow loads (file parsing) can be split so that most of the work happens on a worker thread:
+ *
+ * Load< Thing > thing(LoadTagDefault, LoadInBackground, []() -> std::function< Thing const *() > {
+ *     Thing *ret = new Thing(data_path("thing.dat")); //runs on a worker thread: no OpenGL, no other Load<>'s
+ *     return [ret]() -> Thing const * {
+ *         ret->upload(); //runs on the main thread, in tag/list order like any other load function
+ *         return ret;
+ *     };
+ * });
+ *
+ * Background parts all start as soon as loading starts; the main-thread parts still run in order.
+ *
  */
 
 #include <functional>
 #include <stdexcept>
+#include <cstdint>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
@@ -36,16 +49,32 @@ enum LoadTag : uint32_t {
 // (only call *before* "call_load_functions()")
 void add_load_function(LoadTag tag, std::function< void() > const &fn);
 
-//Call all loading functions:
+//Add a function that runs on a worker thread and returns a function to finish loading on the main thread:
+// (only call *before* "start_load_functions()")
+void add_background_load_function(LoadTag tag, std::function< std::function< void() >() > const &fn);
+
+//Loading can be run all at once:
 // (loading functions may throw exceptions if they fail.)
-// (only call *once*)
-void call_load_functions();
+// (only call *once*, and not along with start_load_functions())
+// 'on_progress', if given, is called after each function finishes
+void call_load_functions(std::function< void(uint32_t done, uint32_t total) > const &on_progress = nullptr);
+
+//...or a bit at a time, so that the main thread can keep drawing frames (see LoadingMode):
+// start_load_functions() launches all background functions (only call *once*);
+// poll_load_functions() runs main-thread functions in order until it reaches one whose background part isn't done yet,
+//  then returns true if everything has been loaded.
+//  (exceptions thrown by background functions are re-thrown here)
+void start_load_functions();
+bool poll_load_functions(std::function< void(uint32_t done, uint32_t total) > const &on_progress = nullptr);
 
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
 T const *new_T() { return new T; }
 
+//marker for Load< T >'s background-loading constructor:
+enum LoadBackground { LoadInBackground };
+
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
@@ -58,6 +87,19 @@ struct Load {
 		});
 	}
 
+	//...or a function to call on a worker thread, which returns the function to call on the main thread:
+	Load(LoadTag tag, LoadBackground, const std::function< std::function< T const *() >() > &background_fn) : value(nullptr) {
+		add_background_load_function(tag, [this,background_fn]() -> std::function< void() > {
+			std::function< T const *() > finish_fn = background_fn();
+			return [this,finish_fn](){
+				this->value = finish_fn();
+				if (!(this->value)) {
+					throw std::runtime_error("Loading failed.");
+				}
+			};
+		});
+	}
+
 	//Make a "Load< T >" behave like a "T const *":
 	explicit operator bool() { return value != nullptr; }
 	operator T const *() { return value; }
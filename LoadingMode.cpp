@@ -0,0 +1,49 @@
+#include "LoadingMode.hpp"
+
+#include "Load.hpp"
+#include "GL.hpp"
+#include "gl_errors.hpp"
+
+LoadingMode::LoadingMode(std::function< std::shared_ptr< Mode >() > const &next_) : next(next_) {
+}
+
+LoadingMode::~LoadingMode() {
+}
+
+void LoadingMode::update(float elapsed) {
+	bool finished = poll_load_functions([this](uint32_t done_, uint32_t total_) {
+		done = done_;
+		total = total_;
+	});
+
+	if (finished) {
+		Mode::set_current(next());
+	}
+}
+
+void LoadingMode::draw(glm::uvec2 const &drawable_size) {
+	//n.b. nothing is drawn with shaders here, since programs may not have been loaded yet;
+	// the progress bar is just a scissored clear:
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	float amount = (total ? float(done) / float(total) : 0.0f);
+
+	//bar outline, then filled portion:
+	GLint x = GLint(0.1f * drawable_size.x);
+	GLint y = GLint(0.45f * drawable_size.y);
+	GLsizei w = GLsizei(0.8f * drawable_size.x);
+	GLsizei h = GLsizei(0.1f * drawable_size.y);
+
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(x, y, w, h);
+	glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glScissor(x, y, GLsizei(amount * w), h);
+	glClearColor(0.9f, 0.8f, 0.5f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+
+	GL_ERRORS();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * LoadingMode keeps frames coming while Load<> functions run:
+ *  each update() runs whatever loading is ready (see poll_load_functions()),
+ *  draw() shows a progress bar, and once everything is loaded the mode made
+ *  by 'next' becomes current.
+ *
+ * Call start_load_functions() before making a LoadingMode current.
+ *
+ */
+
+#include "Mode.hpp"
+
+#include <functional>
+#include <memory>
+
+struct LoadingMode : Mode {
+	LoadingMode(std::function< std::shared_ptr< Mode >() > const &next);
+	virtual ~LoadingMode();
+
+	//functions called by main loop:
+	virtual void update(float elapsed) override;
+	virtual void draw(glm::uvec2 const &drawable_size) override;
+
+	//----- game state -----
+
+	//makes the mode to switch to once loading is done:
+	// (called after loading, since modes usually use Load<>'ed data in their constructors)
+	std::function< std::shared_ptr< Mode >() > next;
+
+	//progress as of the last update():
+	uint32_t done = 0;
+	uint32_t total = 0;
+};
@@ -1,94 +1,215 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "gl_state.hpp"
+#include "Scene.hpp"
 
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
+#include <unordered_map>
 #include <cstddef>
+#include <cstring>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+MeshBuffer::MeshBuffer(std::string const &filename, bool upload_now, bool keep_vertices) {
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct")) {
+		throw std::runtime_error("Unknown file type '" + filename + "'");
+	}
 
-	std::ifstream file(filename, std::ios::binary);
+	mapped.reset(new MappedFile(filename));
+	char const *end = load(mapped->begin(), mapped->end(), filename, keep_vertices);
 
-	GLuint total = 0;
+	if (end != mapped->end()) {
+		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	}
 
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
-	};
-	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	if (mapped_vertices.data == nullptr) mapped.reset(); //(everything was copied out)
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	if (upload_now) upload();
+}
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+MeshBuffer::MeshBuffer(std::unique_ptr< MappedFile > &&file, char const *begin, std::string const &name, bool upload_now, bool keep_vertices) {
+	mapped = std::move(file);
+	char const *end = load(begin, mapped->end(), name, keep_vertices);
 
-		total = GLuint(data.size()); //store total for later checks on index
+	if (end != mapped->end()) {
+		std::cerr << "WARNING: trailing data in mesh data '" << name << "'" << std::endl;
+	}
 
-		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
-	} else {
-		throw std::runtime_error("Unknown file type '" + filename + "'");
+	if (mapped_vertices.data == nullptr) mapped.reset(); //(everything was copied out)
+
+	if (upload_now) upload();
+}
+
+MeshBuffer::MeshBuffer(std::vector< Vertex > const &vertices_, std::map< std::string, Mesh > const &meshes_, bool upload_now) : meshes(meshes_), vertices(vertices_) {
+	for (auto &nm : meshes) {
+		Mesh &mesh = nm.second;
+		if (!(mesh.start <= vertices.size() && mesh.count <= vertices.size() - mesh.start)) {
+			throw std::runtime_error("mesh '" + nm.first + "' has out-of-range vertex start/count");
+		}
+		mesh.index_type = 0;
+		mesh.vertex_start = mesh.start;
+		mesh.vertex_count = mesh.count;
+		mesh.cluster_start = mesh.cluster_count = 0;
+		mesh.min = glm::vec3( std::numeric_limits< float >::infinity());
+		mesh.max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (uint32_t v = mesh.start; v < mesh.start + mesh.count; ++v) {
+			mesh.min = glm::min(mesh.min, vertices[v].Position);
+			mesh.max = glm::max(mesh.max, vertices[v].Position);
+		}
 	}
+	weld();
+	if (upload_now) upload();
+}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+MeshBuffer::~MeshBuffer() {
+	if (!vaos.empty()) glDeleteVertexArrays(GLsizei(vaos.size()), vaos.data());
+	if (buffer != 0) glDeleteBuffers(1, &buffer);
+	if (index_buffer != 0) glDeleteBuffers(1, &index_buffer);
+	if (!vaos.empty() || buffer != 0 || index_buffer != 0) gl_state.invalidate(); //(they might have been bound)
+}
+
+char const *MeshBuffer::load(char const *begin, char const *end, std::string const &name, bool keep_vertices) {
+	char const *at = begin;
+
+	//data chunk (copied out below, unless it can stay where it is):
+	ChunkView< Vertex > vertex_data;
+	view_chunk(&at, end, "pnct", &vertex_data);
+
+	GLuint total = GLuint(vertex_data.size()); //store total for later checks on index
+
+	ChunkView< char > strings;
+	view_chunk(&at, end, "str0", &strings);
 
+	ChunkView< uint32_t > index_data;
 	{ //read index chunk, add to meshes:
-		struct IndexEntry {
-			uint32_t name_begin, name_end;
-			uint32_t vertex_begin, vertex_end;
-		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+		ChunkView< IndexEntry > index;
+		view_chunk(&at, end, "idx0", &index);
+
+		//indexed files follow with index ranges and index data:
+		ChunkView< IndexRange > ranges;
+		if (next_chunk_is(at, end, "idx1")) {
+			view_chunk(&at, end, "idx1", &ranges);
+			view_chunk(&at, end, "ind0", &index_data);
+			if (ranges.size() != index.size()) {
+				throw std::runtime_error("index ranges don't match index entries");
+			}
+		}
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		//...and, optionally, with clusters:
+		ChunkView< ClusterRange > cluster_ranges;
+		if (ranges.size() != 0 && next_chunk_is(at, end, "cls0")) {
+			ChunkView< MeshCluster > cluster_data;
+			view_chunk(&at, end, "cls0", &cluster_ranges);
+			view_chunk(&at, end, "clu0", &cluster_data);
+			if (cluster_ranges.size() != index.size()) {
+				throw std::runtime_error("cluster ranges don't match index entries");
+			}
+			clusters.reserve(cluster_data.size());
+			for (MeshCluster const &cluster : cluster_data) {
+				clusters.emplace_back(cluster);
+			}
+		}
 
-		for (auto const &entry : index) {
+		//...and, optionally, with each entry's bounds (so that the vertices needn't be read here):
+		ChunkView< MeshBounds > bounds;
+		if (next_chunk_is(at, end, "bnd0")) {
+			view_chunk(&at, end, "bnd0", &bounds);
+			if (bounds.size() != index.size()) {
+				throw std::runtime_error("mesh bounds don't match index entries");
+			}
+		}
+
+		for (uint32_t i = 0; i < index.size(); ++i) {
+			IndexEntry const &entry = index[i];
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
 			}
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			std::string mesh_name(strings.data + entry.name_begin, strings.data + entry.name_end);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+			mesh.vertex_start = entry.vertex_begin;
+			mesh.vertex_count = entry.vertex_end - entry.vertex_begin;
+			if (ranges.size() != 0) {
+				IndexRange const &range = ranges[i];
+				if (!(range.index_begin <= range.index_end && range.index_end <= index_data.size())) {
+					throw std::runtime_error("index range has out-of-range index begin/end");
+				}
+				for (uint32_t e = range.index_begin; e < range.index_end; ++e) {
+					if (index_data[e] >= mesh.vertex_count) {
+						throw std::runtime_error("mesh '" + mesh_name + "' has an index past its vertices");
+					}
+				}
+				mesh.index_type = GL_UNSIGNED_INT; //(narrowed by set_index_type(), below)
+				mesh.start = range.index_begin;
+				mesh.count = range.index_end - range.index_begin;
+			}
+			if (cluster_ranges.size() != 0) {
+				ClusterRange const &range = cluster_ranges[i];
+				if (!(range.cluster_begin <= range.cluster_end && range.cluster_end <= clusters.size())) {
+					throw std::runtime_error("cluster range has out-of-range cluster begin/end");
+				}
+				//clusters must cover the mesh's indices, in order, a triangle at a time:
+				GLuint at = mesh.start;
+				for (uint32_t c = range.cluster_begin; c < range.cluster_end; ++c) {
+					MeshCluster const &cluster = clusters[c];
+					if (!(cluster.index_begin == at && cluster.index_begin <= cluster.index_end && (cluster.index_end - cluster.index_begin) % 3 == 0)) {
+						throw std::runtime_error("mesh '" + mesh_name + "' has clusters that don't follow its indices");
+					}
+					at = cluster.index_end;
+				}
+				if (range.cluster_begin != range.cluster_end && at != mesh.start + mesh.count) {
+					throw std::runtime_error("mesh '" + mesh_name + "' has clusters that don't cover its indices");
+				}
+				mesh.cluster_start = range.cluster_begin;
+				mesh.cluster_count = range.cluster_end - range.cluster_begin;
+			}
+			if (ranges.size() == 0) {
+				mesh.start = mesh.vertex_start;
+				mesh.count = mesh.vertex_count;
+			}
+			if (bounds.size() != 0) {
+				mesh.min = bounds[i].min;
+				mesh.max = bounds[i].max;
+			} else {
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					mesh.min = glm::min(mesh.min, vertex_data[v].Position);
+					mesh.max = glm::max(mesh.max, vertex_data[v].Position);
+				}
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
+			bool inserted = meshes.insert(std::make_pair(mesh_name, mesh)).second;
 			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+				std::cerr << "WARNING: mesh name '" + mesh_name + "' in '" + name + "' collides with existing mesh." << std::endl;
 			}
 		}
 	}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	//vertex and index data stay in place only if asked and nothing needs to change them:
+	// (older, non-indexed, files store every triangle's vertices separately, and are welded below)
+	if (!keep_vertices && index_data.size() != 0) {
+		mapped_vertices = vertex_data;
+		mapped_indices = index_data;
+	} else {
+		vertices.resize(vertex_data.size());
+		if (!vertices.empty()) std::memcpy(vertices.data(), vertex_data.data, vertices.size() * sizeof(Vertex));
+		indices.resize(index_data.size());
+		if (!indices.empty()) std::memcpy(indices.data(), index_data.data, indices.size() * sizeof(uint32_t));
 	}
 
+	weld();
+	set_index_type();
+
 	/* //DEBUG:
-	std::cout << "File '" << filename << "' contained meshes";
+	std::cout << "'" << name << "' contained meshes";
 	for (auto const &m : meshes) {
 		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
 		std::cout << " '" << m.first << "'";
@@ -96,6 +217,317 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	}
 	std::cout << std::endl;
 	*/
+
+	return at;
+}
+
+void MeshBuffer::weld() {
+	bool any = false;
+	for (auto const &nm : meshes) {
+		if (nm.second.type == GL_TRIANGLES && nm.second.index_type == 0) any = true;
+	}
+	if (!any) return;
+
+	//vertices are compared bit-for-bit:
+	struct VertexHash {
+		Vertex const *vertices;
+		size_t operator()(uint32_t v) const {
+			//FNV-1a:
+			uint64_t hash = 0xcbf29ce484222325ULL;
+			uint8_t const *bytes = reinterpret_cast< uint8_t const * >(&vertices[v]);
+			for (size_t i = 0; i < sizeof(Vertex); ++i) {
+				hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+			}
+			return size_t(hash);
+		}
+	};
+	struct VertexEqual {
+		Vertex const *vertices;
+		bool operator()(uint32_t a, uint32_t b) const {
+			return std::memcmp(&vertices[a], &vertices[b], sizeof(Vertex)) == 0;
+		}
+	};
+
+	//every mesh's vertices are copied to 'welded' (once per distinct range, in case meshes share):
+	std::vector< Vertex > welded;
+	welded.reserve(vertices.size());
+	std::map< std::pair< GLuint, GLuint >, Mesh > merged; //source vertex range -> welded mesh
+	std::map< std::pair< GLuint, GLuint >, GLuint > copied; //source vertex range -> new vertex_start
+	std::unordered_map< uint32_t, uint32_t, VertexHash, VertexEqual > first(0, VertexHash{vertices.data()}, VertexEqual{vertices.data()});
+
+	for (auto &nm : meshes) {
+		Mesh &mesh = nm.second;
+		auto range = std::make_pair(mesh.vertex_start, mesh.vertex_count);
+
+		if (mesh.type != GL_TRIANGLES || mesh.index_type != 0) {
+			//already indexed (or not made of triangles), so copy as-is:
+			auto f = copied.find(range);
+			if (f == copied.end()) {
+				f = copied.emplace(range, GLuint(welded.size())).first;
+				welded.insert(welded.end(), vertices.begin() + mesh.vertex_start, vertices.begin() + mesh.vertex_start + mesh.vertex_count);
+			}
+			mesh.vertex_start = f->second;
+			if (mesh.index_type == 0) mesh.start = mesh.vertex_start;
+			continue;
+		}
+
+		auto f = merged.find(range);
+		if (f == merged.end()) {
+			f = merged.emplace(range, mesh).first;
+			Mesh &to = f->second;
+			to.index_type = GL_UNSIGNED_INT; //(narrowed by set_index_type(), below)
+			to.start = GLuint(indices.size());
+			to.vertex_start = GLuint(welded.size());
+			first.clear();
+			first.reserve(mesh.vertex_count);
+			for (uint32_t v = mesh.vertex_start; v < mesh.vertex_start + mesh.vertex_count; ++v) {
+				auto ret = first.emplace(v, uint32_t(welded.size()) - to.vertex_start);
+				if (ret.second) welded.emplace_back(vertices[v]);
+				indices.emplace_back(ret.first->second);
+			}
+			to.vertex_count = GLuint(welded.size()) - to.vertex_start;
+			to.count = GLuint(indices.size()) - to.start;
+		}
+		mesh = f->second; //(same range, so same bounds)
+	}
+
+	vertices = std::move(welded);
+	set_index_type();
+}
+
+void MeshBuffer::set_index_type() {
+	GLuint most = 0;
+	bool any = false;
+	for (auto const &nm : meshes) {
+		if (nm.second.index_type == 0) continue;
+		any = true;
+		most = std::max(most, nm.second.vertex_count);
+	}
+	index_type = (!any ? 0 : (most <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT));
+	for (auto &nm : meshes) {
+		if (nm.second.index_type != 0) nm.second.index_type = index_type;
+	}
+}
+
+//compact vertex positions are quantized to the bounds of the meshes using them (see Mesh::position_scale):
+namespace {
+	struct CompactRange {
+		GLuint begin, end; //vertices
+		glm::vec3 min;
+		glm::vec3 to_unit; //(zero on axes with no extent)
+	};
+}
+
+//plan the quantization of positions, setting meshes' position_scale/position_offset:
+// returns non-overlapping ranges, sorted by first vertex
+static std::vector< CompactRange > plan_compact(std::map< std::string, Mesh > &meshes) {
+	//meshes that share vertices have the same bounds, unless vertex ranges overlap without matching -- then every mesh uses the bounds of them all:
+	std::map< std::pair< GLuint, GLuint >, std::pair< glm::vec3, glm::vec3 > > ranges; //vertex range -> bounds
+	glm::vec3 all_min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 all_max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (auto const &nm : meshes) {
+		Mesh const &mesh = nm.second;
+		if (!(mesh.min.x <= mesh.max.x) || mesh.vertex_count == 0) continue;
+		auto &bounds = ranges.emplace(std::make_pair(mesh.vertex_start, mesh.vertex_count), std::make_pair(mesh.min, mesh.max)).first->second;
+		bounds.first = glm::min(bounds.first, mesh.min);
+		bounds.second = glm::max(bounds.second, mesh.max);
+		all_min = glm::min(all_min, mesh.min);
+		all_max = glm::max(all_max, mesh.max);
+	}
+	GLuint all_begin = -1U;
+	GLuint all_end = 0;
+	bool overlap = false;
+	for (auto const &range : ranges) {
+		if (range.first.first < all_end) overlap = true;
+		all_begin = std::min(all_begin, range.first.first);
+		all_end = std::max(all_end, range.first.first + range.first.second);
+	}
+	if (overlap) {
+		for (auto &range : ranges) {
+			range.second = std::make_pair(all_min, all_max);
+		}
+	}
+
+	for (auto &nm : meshes) {
+		Mesh &mesh = nm.second;
+		auto f = ranges.find(std::make_pair(mesh.vertex_start, mesh.vertex_count));
+		if (f == ranges.end()) {
+			mesh.position_scale = glm::vec3(1.0f);
+			mesh.position_offset = glm::vec3(0.0f);
+		} else {
+			mesh.position_scale = f->second.second - f->second.first;
+			mesh.position_offset = f->second.first;
+		}
+	}
+
+	auto make_range = [](GLuint begin, GLuint end, glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 extent = max - min;
+		return CompactRange{ begin, end, min, glm::vec3(
+			(extent.x > 0.0f ? 1.0f / extent.x : 0.0f),
+			(extent.y > 0.0f ? 1.0f / extent.y : 0.0f),
+			(extent.z > 0.0f ? 1.0f / extent.z : 0.0f)
+		)};
+	};
+	std::vector< CompactRange > ret;
+	if (overlap) {
+		ret.emplace_back(make_range(all_begin, all_end, all_min, all_max));
+	} else {
+		for (auto const &range : ranges) {
+			ret.emplace_back(make_range(range.first.first, range.first.first + range.first.second, range.second.first, range.second.second));
+		}
+	}
+	return ret;
+}
+
+//convert a vertex to the compact format ('range' is null for vertices no mesh uses):
+static MeshBuffer::CompactVertex make_compact(MeshBuffer::Vertex const &from, CompactRange const *range) {
+	auto snorm10 = [](float x) -> uint32_t {
+		return uint32_t(int32_t(std::round(glm::clamp(x, -1.0f, 1.0f) * 511.0f))) & 0x3ff;
+	};
+
+	MeshBuffer::CompactVertex to;
+	to.Position = glm::u16vec3(0);
+	if (range) {
+		glm::vec3 unit = glm::clamp((from.Position - range->min) * range->to_unit, glm::vec3(0.0f), glm::vec3(1.0f));
+		to.Position = glm::u16vec3(glm::round(unit * 65535.0f));
+	}
+	to.pad = 0;
+	glm::vec3 normal = from.Normal;
+	float length = glm::length(normal);
+	if (length > 0.0f) normal /= length;
+	to.Normal = snorm10(normal.x) | (snorm10(normal.y) << 10) | (snorm10(normal.z) << 20);
+	to.Color = from.Color;
+	to.TexCoord = glm::u16vec2(glm::packHalf1x16(from.TexCoord.x), glm::packHalf1x16(from.TexCoord.y));
+	return to;
+}
+
+void MeshBuffer::upload() {
+	//data comes from the CPU copy or, if there isn't one, straight from the mapped file:
+	ChunkView< Vertex > vertex_data = (mapped ? mapped_vertices : ChunkView< Vertex >{ reinterpret_cast< char const * >(vertices.data()), vertices.size() });
+	ChunkView< uint32_t > index_data = (mapped ? mapped_indices : ChunkView< uint32_t >{ reinterpret_cast< char const * >(indices.data()), indices.size() });
+
+	//copy 'count' elements of 'size' bytes to the buffer bound to 'target', at most upload_slice bytes at a time:
+	// ('convert' fills a slice of staging data and returns a pointer to it -- or just points into the source)
+	auto upload_slices = [this](GLenum target, size_t count, size_t size, auto const &convert) {
+		glBufferData(target, count * size, nullptr, GL_STATIC_DRAW);
+		size_t per_slice = std::max< size_t >(1, upload_slice / size);
+		for (size_t begin = 0; begin < count; begin += per_slice) {
+			size_t end = std::min(count, begin + per_slice);
+			glBufferSubData(target, GLintptr(begin * size), GLsizeiptr((end - begin) * size), convert(begin, end));
+		}
+	};
+
+	glGenBuffers(1, &buffer);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, buffer);
+
+	if (compact) {
+		std::vector< CompactRange > ranges = plan_compact(meshes);
+		std::vector< CompactVertex > staging;
+		uint32_t r = 0;
+		upload_slices(GL_ARRAY_BUFFER, vertex_data.size(), sizeof(CompactVertex), [&](size_t begin, size_t end) -> void const * {
+			staging.resize(end - begin);
+			for (size_t v = begin; v < end; ++v) {
+				while (r < ranges.size() && ranges[r].end <= v) ++r;
+				CompactRange const *range = (r < ranges.size() && ranges[r].begin <= v ? &ranges[r] : nullptr);
+				staging[v - begin] = make_compact(vertex_data[v], range);
+			}
+			return staging.data();
+		});
+
+		//store attrib locations:
+		// (n.b. packed 2_10_10_10 attributes always have size 4; the shader just ignores w)
+		Position = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Position));
+		Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Color));
+		TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), offsetof(CompactVertex, TexCoord));
+	} else {
+		upload_slices(GL_ARRAY_BUFFER, vertex_data.size(), sizeof(Vertex), [&](size_t begin, size_t) -> void const * {
+			return vertex_data.data + begin * sizeof(Vertex);
+		});
+
+		//store attrib locations:
+		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+	}
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	if (index_data.size() != 0) {
+		glGenBuffers(1, &index_buffer);
+
+		//(GL_ELEMENT_ARRAY_BUFFER bindings belong to vertex arrays, so upload through a binding that doesn't)
+		gl_state.bind_buffer(GL_COPY_WRITE_BUFFER, index_buffer);
+		if (index_type == GL_UNSIGNED_SHORT) {
+			std::vector< uint16_t > staging;
+			upload_slices(GL_COPY_WRITE_BUFFER, index_data.size(), sizeof(uint16_t), [&](size_t begin, size_t end) -> void const * {
+				staging.resize(end - begin);
+				for (size_t i = begin; i < end; ++i) {
+					staging[i - begin] = uint16_t(index_data[i]);
+				}
+				return staging.data();
+			});
+		} else {
+			upload_slices(GL_COPY_WRITE_BUFFER, index_data.size(), sizeof(uint32_t), [&](size_t begin, size_t) -> void const * {
+				return index_data.data + begin * sizeof(uint32_t);
+			});
+		}
+		gl_state.bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	//(the mapped file isn't needed once its data is in OpenGL)
+	mapped_vertices = ChunkView< Vertex >();
+	mapped_indices = ChunkView< uint32_t >();
+	mapped.reset();
+}
+
+void MeshBuffer::save(std::ostream &to) const {
+	write_chunk("pnct", vertices, &to);
+
+	bool indexed = (!meshes.empty() && meshes.begin()->second.index_type != 0);
+
+	std::vector< char > strings;
+	std::vector< IndexEntry > index;
+	std::vector< IndexRange > ranges;
+	std::vector< ClusterRange > cluster_ranges;
+	std::vector< MeshBounds > bounds;
+	for (auto const &nm : meshes) {
+		if (nm.second.type != GL_TRIANGLES) {
+			throw std::runtime_error("can't save mesh '" + nm.first + "': only triangle meshes can be stored");
+		}
+		if ((nm.second.index_type != 0) != indexed) {
+			throw std::runtime_error("can't save mesh '" + nm.first + "': indexed and non-indexed meshes can't be stored together");
+		}
+		IndexEntry entry;
+		entry.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), nm.first.begin(), nm.first.end());
+		entry.name_end = uint32_t(strings.size());
+		entry.vertex_begin = nm.second.vertex_start;
+		entry.vertex_end = nm.second.vertex_start + nm.second.vertex_count;
+		index.emplace_back(entry);
+		bounds.emplace_back(MeshBounds{ nm.second.min, nm.second.max });
+		if (indexed) {
+			IndexRange range;
+			range.index_begin = nm.second.start;
+			range.index_end = nm.second.start + nm.second.count;
+			ranges.emplace_back(range);
+			ClusterRange cluster_range;
+			cluster_range.cluster_begin = nm.second.cluster_start;
+			cluster_range.cluster_end = nm.second.cluster_start + nm.second.cluster_count;
+			cluster_ranges.emplace_back(cluster_range);
+		}
+	}
+	write_chunk("str0", strings, &to);
+	write_chunk("idx0", index, &to);
+	if (indexed) {
+		write_chunk("idx1", ranges, &to);
+		write_chunk("ind0", indices, &to);
+		if (!clusters.empty()) {
+			write_chunk("cls0", cluster_ranges, &to);
+			write_chunk("clu0", clusters, &to);
+		}
+	}
+	write_chunk("bnd0", bounds, &to);
 }
 
 const Mesh &MeshBuffer::lookup(std::string const &name) const {
@@ -106,15 +538,37 @@ const Mesh &MeshBuffer::lookup(std::string const &name) const {
 	return f->second;
 }
 
+std::vector< Mesh const * > MeshBuffer::lookup_lods(std::string const &name) const {
+	std::vector< Mesh const * > lods;
+	while (true) {
+		auto f = meshes.find(name + ".LOD" + std::to_string(lods.size() + 1));
+		if (f == meshes.end()) break;
+		lods.emplace_back(&f->second);
+	}
+	return lods;
+}
+
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+	return make_vao_for_program(program, 0);
+}
+
+GLuint MeshBuffer::make_instanced_vao_for_program(GLuint program) const {
+	return make_vao_for_program(program, Scene::instance_buffer());
+}
+
+GLuint MeshBuffer::make_vao_for_program(GLuint program, GLuint instance_buffer) const {
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	vaos.emplace_back(vao); //(so it is freed with the buffer, even if this throws)
+	gl_state.bind_vertex_array(vao);
+
+	//indexed meshes draw from the index buffer:
+	if (index_buffer != 0) gl_state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
 
 	//Try to bind all attributes in this buffer:
 	std::set< GLuint > bound;
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, buffer);
 	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
 		if (attrib.size == 0) return; //don't bind empty attribs
 		GLint location = glGetAttribLocation(program, name);
@@ -127,8 +581,27 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Normal", Normal);
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+
+	//Bind per-instance matrices (one attribute location per matrix column):
+	if (instance_buffer != 0) {
+		gl_state.bind_buffer(GL_ARRAY_BUFFER, instance_buffer);
+		auto bind_instance_attribute = [&](char const *name, GLint rows, GLuint columns, GLsizei offset) {
+			GLint location = glGetAttribLocation(program, name);
+			if (location == -1) return;
+			for (GLuint c = 0; c < columns; ++c) {
+				glVertexAttribPointer(location + c, rows, GL_FLOAT, GL_FALSE, sizeof(Scene::InstanceData), (GLbyte *)0 + offset + c * rows * sizeof(float));
+				glEnableVertexAttribArray(location + c);
+				glVertexAttribDivisor(location + c, 1);
+			}
+			bound.insert(location);
+		};
+		bind_instance_attribute("INSTANCE_OBJECT_TO_CLIP", 4, 4, offsetof(Scene::InstanceData, object_to_clip));
+		bind_instance_attribute("INSTANCE_OBJECT_TO_LIGHT", 3, 4, offsetof(Scene::InstanceData, object_to_light));
+		bind_instance_attribute("INSTANCE_NORMAL_TO_LIGHT", 3, 3, offsetof(Scene::InstanceData, normal_to_light));
+	}
+
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, 0);
+	gl_state.bind_vertex_array(0);
 
 	//Check that all active attributes were bound:
 	GLint active = 0;
@@ -7,49 +7,218 @@
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
  *
+ * Triangle meshes are usually indexed: each mesh's distinct vertices are
+ *  stored once, and the mesh is drawn (with glDrawElementsBaseVertex) from a
+ *  range of the MeshBuffer's index buffer. Files with index chunks are loaded
+ *  as-is; older files' vertices are welded when loaded (see weld()).
+ *
+ * Large indexed meshes may also be split into clusters of triangles (see
+ *  MeshCluster and build_clusters() in mesh_optimizer.hpp), which Scene culls
+ *  one by one.
+ *
  */
 
 #include "GL.hpp"
+#include "mapped_file.hpp"
+#include "read_write_chunk.hpp"
 #include <glm/glm.hpp>
+#include <iostream>
 #include <map>
+#include <memory>
 #include <limits>
 #include <string>
+#include <vector>
 
 
+//A cluster ("meshlet") is a range of a mesh's indices covering a few dozen spatially-close triangles,
+// along with what's needed to cull it on its own:
+struct MeshCluster {
+	uint32_t index_begin, index_end; //range of MeshBuffer::indices (within its mesh's range)
+	glm::vec3 min, max; //bounding box, in the mesh's (object) space
+	//normal cone: the cluster faces away from any viewer at 'eye' with dot(normalize(cone_apex - eye), cone_axis) >= cone_cutoff
+	// (cone_cutoff is more than 1 if no viewpoint sees only back faces)
+	// (stored for renderers that cull back faces; Scene doesn't, so it only culls clusters by their bounds)
+	glm::vec3 cone_apex;
+	float cone_cutoff;
+	glm::vec3 cone_axis;
+	float padding_;
+};
+static_assert(sizeof(MeshCluster) == 4*2 + 4*3*2 + 4*4 + 4*4, "MeshCluster is packed.");
+
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (for indexed meshes: of first index)
+	GLuint count = 0; //count of vertices (for indexed meshes: of indices)
+
+	//Indexed meshes draw 'count' of MeshBuffer::indices from 'start', each offset by 'vertex_start':
+	GLenum index_type = 0; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT (the buffer's MeshBuffer::index_type); 0 if not indexed
+
+	//vertices the mesh uses (for non-indexed meshes, the same as start/count):
+	GLuint vertex_start = 0;
+	GLuint vertex_count = 0;
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Compact buffers (see MeshBuffer::compact) store positions in [0,1]^3, relative to the bounds above;
+	// object-space positions are position_offset + position_scale * (position read by the shader):
+	// (set by MeshBuffer::upload(); see Scene::Drawable::Pipeline, which folds these into the object transform)
+	glm::vec3 position_scale = glm::vec3(1.0f);
+	glm::vec3 position_offset = glm::vec3(0.0f);
+
+	//(optional) clusters covering all of the mesh's indices, in order (see MeshBuffer::clusters; 0 for none):
+	GLuint cluster_start = 0;
+	GLuint cluster_count = 0;
 };
 
 struct MeshBuffer {
-	//construct from a file:
+	//construct from a file (which is mapped into memory and parsed in place):
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	// if 'upload_now' is false, no OpenGL calls are made (so this may run on a worker thread) -- call upload() before use.
+	// if 'keep_vertices' is false, indexed files' vertex and index data are left in the mapping -- not copied to 'vertices'
+	//  and 'indices' -- and upload() reads them from there (then releases the mapping), so they are never all in memory
+	//  at once. (The buffer can then only be drawn: weld(), optimize_meshes(), baking, and so on need the CPU copy.)
+	MeshBuffer(std::string const &filename, bool upload_now = true, bool keep_vertices = true);
+
+	//construct from the chunks of a .pnct file embedded in some other (already mapped) file, starting at 'begin':
+	// (e.g., the static bake cache; 'name' is used in messages, the rest is as above)
+	// note: will throw if data fails to read.
+	MeshBuffer(std::unique_ptr< MappedFile > &&file, char const *begin, std::string const &name, bool upload_now = true, bool keep_vertices = true);
+
+	//vertex format used by .pnct files:
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+	//compact vertex format (20 bytes instead of 36) used in 'buffer' if 'compact' is set when upload() is called:
+	// (shaders read the same attributes, so programs don't need to change -- but the draw code needs
+	//  to apply each mesh's position_scale/position_offset, as Scene does)
+	struct CompactVertex {
+		glm::u16vec3 Position; //unsigned normalized, relative to the mesh's bounds
+		uint16_t pad;
+		uint32_t Normal; //signed normalized 10:10:10 (GL_INT_2_10_10_10_REV)
+		glm::u8vec4 Color;
+		glm::u16vec2 TexCoord; //half floats
+	};
+	static_assert(sizeof(CompactVertex) == 2*4+4+4*1+2*2, "CompactVertex is packed.");
+	bool compact = false;
+
+	//construct from vertices in memory ('meshes' are non-indexed ranges of 'vertices'; their bounds are recomputed, and triangle meshes are welded):
+	MeshBuffer(std::vector< Vertex > const &vertices, std::map< std::string, Mesh > const &meshes, bool upload_now = true);
+
+	//frees 'buffer', 'index_buffer', and every vertex array object made by make_*vao_for_program():
+	// (so those vertex arrays must not be used after the MeshBuffer is gone)
+	~MeshBuffer();
+
+	//owns OpenGL objects, so copying is not allowed:
+	MeshBuffer(MeshBuffer const &) = delete;
+	MeshBuffer &operator=(MeshBuffer const &) = delete;
+
+	//turn non-indexed triangle meshes into indexed ones that store each distinct vertex once:
+	// (vertices are only merged within a mesh, and only if they match bit-for-bit; no OpenGL calls, so call before upload())
+	void weld();
+
+	//create 'buffer' (and 'index_buffer') from 'vertices' (and 'indices') and set attribs (done by the constructors unless asked not to):
+	// (if 'compact' is set, also sets each mesh's position_scale/position_offset)
+	// data is copied to OpenGL in glBufferSubData calls of at most 'upload_slice' bytes, so converting it never takes a whole extra copy:
+	void upload();
+	size_t upload_slice = 1 << 20;
+
+	//write in the format read by the stream constructor (only works for GL_TRIANGLES meshes, which must all be indexed or all not):
+	void save(std::ostream &to) const;
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
 	const Mesh &lookup(std::string const &name) const;
+
+	//look up lower levels of detail of a mesh, named by convention 'name.LOD1', 'name.LOD2', ...:
+	// (stops at the first missing level, so a mesh without any gives an empty list)
+	std::vector< Mesh const * > lookup_lods(std::string const &name) const;
 	
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
 	GLuint make_vao_for_program(GLuint program) const;
 
+	//build a vertex array object for an instanced program (see Scene::Drawable::Pipeline::instanced):
+	// like the above, but also binds per-instance attributes INSTANCE_OBJECT_TO_CLIP, INSTANCE_OBJECT_TO_LIGHT,
+	// and INSTANCE_NORMAL_TO_LIGHT to Scene::instance_buffer()
+	GLuint make_instanced_vao_for_program(GLuint program) const;
+
+	//index of the vertex (in 'vertices') used by the i'th element drawn from a mesh (or a drawable's pipeline):
+	// ('element' counts from the start of the buffer's indices for indexed meshes, and of its vertices otherwise)
+	uint32_t element_vertex(GLenum index_type, GLuint vertex_start, GLuint element) const {
+		return (index_type != 0 ? vertex_start + indices[element] : element);
+	}
+
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
 
+	//...and the element array buffer with the index data (bound by make_vao_for_program; 0 if no meshes are indexed):
+	GLuint index_buffer = 0;
+	GLenum index_type = 0; //type of the data in index_buffer: GL_UNSIGNED_SHORT if every mesh has at most 65536 vertices, otherwise GL_UNSIGNED_INT
+
 	//-- internals ---
 
+	//shared by make_vao_for_program and make_instanced_vao_for_program (instance_buffer == 0 for none):
+	GLuint make_vao_for_program(GLuint program, GLuint instance_buffer) const;
+	//vertex array objects made by the above (deleted along with the buffer):
+	mutable std::vector< GLuint > vaos;
+
 	//used by the lookup() function:
 	std::map< std::string, Mesh > meshes;
 
+	//CPU-side copy of the vertex data (kept so geometry can be re-processed, e.g., by bake_static_drawables()):
+	std::vector< Vertex > vertices;
+	//...and of the index data (each index is relative to its mesh's vertex_start):
+	std::vector< uint32_t > indices;
+	//...unless they were left in the mapped file, for upload() to read (see 'keep_vertices', above):
+	std::unique_ptr< MappedFile > mapped;
+	ChunkView< Vertex > mapped_vertices;
+	ChunkView< uint32_t > mapped_indices;
+	//...and clusters of indexed meshes (see Mesh::cluster_start; loaded from the optional cls0/clu0 chunks):
+	// (Scene::Drawable::clusters points in here, so don't change this after setting up drawables)
+	std::vector< MeshCluster > clusters;
+
+	//mesh index entries, as stored in the idx0 chunk:
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+	//ranges of the index data (stored in the ind0 chunk) for each idx0 entry, as stored in the (optional) idx1 chunk:
+	struct IndexRange {
+		uint32_t index_begin, index_end;
+	};
+	static_assert(sizeof(IndexRange) == 8, "Index range should be packed");
+
+	//ranges of the clusters (stored in the clu0 chunk) for each idx0 entry, as stored in the (optional) cls0 chunk:
+	struct ClusterRange {
+		uint32_t cluster_begin, cluster_end;
+	};
+	static_assert(sizeof(ClusterRange) == 8, "Cluster range should be packed");
+
+	//bounding box of each idx0 entry's vertices, as stored in the (optional) bnd0 chunk:
+	// (so that loading needn't read every vertex; must match the vertices, since compact uploads quantize to these bounds)
+	struct MeshBounds {
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(MeshBounds) == 24, "Mesh bounds should be packed");
+
+	void set_index_type(); //pick 'index_type' for the current meshes and copy it to every indexed mesh
+
+	//read chunks from [begin,end) (no OpenGL calls); returns the end of the chunks read:
+	// (vertex and index data are only left in place -- see mapped_vertices -- if !keep_vertices)
+	char const *load(char const *begin, char const *end, std::string const &name, bool keep_vertices);
+
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
 		GLint size = 0;
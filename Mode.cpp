@@ -1,8 +1,18 @@
 #include "Mode.hpp"
 
+#include "render_commands.hpp"
+
 std::shared_ptr< Mode > Mode::current;
 
 void Mode::set_current(std::shared_ptr< Mode > const &new_current) {
 	current = new_current;
 	//NOTE: may wish to, e.g., trigger resize events on new current mode.
 }
+
+void Mode::record(glm::uvec2 const &drawable_size, RenderCommands *commands) {
+	std::shared_ptr< Mode > self = shared_from_this();
+	commands->callback([self, drawable_size](){
+		self->draw(drawable_size);
+	});
+	commands->wait = true;
+}
@@ -5,6 +5,8 @@
 
 #include <memory>
 
+struct RenderCommands;
+
 struct Mode : std::enable_shared_from_this< Mode > {
 	virtual ~Mode() { }
 
@@ -20,6 +22,13 @@ struct Mode : std::enable_shared_from_this< Mode > {
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) = 0;
 
+	//record is called instead of draw when OpenGL calls are made on a separate thread (see gl_thread.hpp):
+	// 'commands' are executed while the next frame's update runs, so they must not refer to state that
+	// update changes (see render_commands.hpp). commands->viewport is already set.
+	//The default records a call to draw and sets commands->wait, which keeps the mode in lock-step with
+	// the GL thread: update and draw both run there, one after the other, so either may call OpenGL.
+	virtual void record(glm::uvec2 const &drawable_size, RenderCommands *commands);
+
 	//Mode::current is the Mode to which events are dispatched.
 	// use 'set_current' to change the current Mode (e.g., to switch to a menu)
 	static std::shared_ptr< Mode > current;
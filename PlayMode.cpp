@@ -4,48 +4,103 @@
 
 #include "DrawLines.hpp"
 #include "Mesh.hpp"
+#include "mesh_optimizer.hpp"
 #include "Load.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
+#include "bake_static_drawables.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <random>
 
 GLuint level_meshes_for_lit_color_texture_program = 0;
-Load< MeshBuffer > level_meshes(LoadTagDefault, []() -> MeshBuffer const* {
-	MeshBuffer const* ret = new MeshBuffer(data_path("level1.pnct"));
-	level_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
-	return ret;
+GLuint level_meshes_for_lit_color_texture_program_instanced = 0;
+//n.b. files are parsed on worker threads; only OpenGL work (and uses of other Load<>'s) happens in the returned functions:
+Load< MeshBuffer > level_meshes(LoadTagDefault, LoadInBackground, []() -> std::function< MeshBuffer const *() > {
+	//(n.b. this keeps the CPU copy of the vertices -- 'keep_vertices' -- so the game gets no memory saving from mapped loading:
+	// the optimizer and clusters below, bake_static_drawables() and the counter's occluder all read it; and level1.pnct
+	// isn't indexed, so it would be copied and welded on load anyway)
+	MeshBuffer *ret = new MeshBuffer(data_path("level1.pnct"), false, true);
+	//(exported meshes come in Blender's face order, so re-order them for the GPU while still on the worker thread)
+	optimize_meshes(ret);
+	//(...and split big ones up so that Scene can cull their parts separately)
+	build_clusters(ret);
+	return [ret]() -> MeshBuffer const * {
+		//(quantized vertices take a bit over half the memory and bandwidth; Scene::draw() undoes the quantization)
+		ret->compact = true;
+		ret->upload();
+		level_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+		level_meshes_for_lit_color_texture_program_instanced = ret->make_instanced_vao_for_program(lit_color_texture_program_instanced->program);
+		return ret;
+	};
 });
 
-Load< Scene > level_scene(LoadTagDefault, []() -> Scene const* {
-	return new Scene(data_path("level1.scene"), [&](Scene& scene, Scene::Transform* transform, std::string const& mesh_name) {
-		Mesh const& mesh = level_meshes->lookup(mesh_name);
-
-		scene.drawables.emplace_back(transform);
-		Scene::Drawable& drawable = scene.drawables.back();
-
-		drawable.pipeline = lit_color_texture_program_pipeline;
-
-		drawable.pipeline.vao = level_meshes_for_lit_color_texture_program;
-		drawable.pipeline.type = mesh.type;
-		drawable.pipeline.start = mesh.start;
-		drawable.pipeline.count = mesh.count;
-
+Load< Scene > level_scene(LoadTagDefault, LoadInBackground, []() -> std::function< Scene const *() > {
+	//mesh lookups need level_meshes, so just note which transforms get which meshes for now:
+	auto attachments = std::make_shared< std::vector< std::pair< Scene::Transform *, std::string > > >();
+	Scene *ret = new Scene(data_path("level1.scene"), [attachments](Scene&, Scene::Transform* transform, std::string const& mesh_name) {
+		attachments->emplace_back(transform, mesh_name);
 	});
+	//(packed scenes are copied with a few bulk array copies, which makes PlayMode's scene(*level_scene) cheap)
+	ret->pack_transforms();
+	return [ret, attachments]() -> Scene const * {
+		for (auto const &[transform, mesh_name] : *attachments) {
+			Mesh const& mesh = level_meshes->lookup(mesh_name);
+
+			ret->drawables.emplace_back(transform);
+			Scene::Drawable& drawable = ret->drawables.back();
+
+			drawable.pipeline = lit_color_texture_program_pipeline;
+
+			drawable.pipeline.vao = level_meshes_for_lit_color_texture_program;
+			drawable.pipeline.instanced.vao = level_meshes_for_lit_color_texture_program_instanced;
+			drawable.pipeline.type = mesh.type;
+			drawable.pipeline.start = mesh.start;
+			drawable.pipeline.count = mesh.count;
+			drawable.pipeline.index_type = mesh.index_type;
+			drawable.pipeline.base_vertex = mesh.vertex_start;
+			drawable.pipeline.position_scale = mesh.position_scale;
+			drawable.pipeline.position_offset = mesh.position_offset;
+
+			drawable.min = mesh.min;
+			drawable.max = mesh.max;
+			drawable.clusters = level_meshes->clusters.data() + mesh.cluster_start;
+			drawable.cluster_count = mesh.cluster_count;
+			drawable.mesh_name_id = ret->intern_name(mesh_name);
+
+			//meshes exported with lower-detail versions switch to them as they shrink on screen:
+			float screen_size = 0.25f;
+			for (Mesh const *lod : level_meshes->lookup_lods(mesh_name)) {
+				drawable.lods.emplace_back();
+				drawable.lods.back().start = lod->start;
+				drawable.lods.back().count = lod->count;
+				drawable.lods.back().base_vertex = lod->vertex_start;
+				drawable.lods.back().position_scale = lod->position_scale;
+				drawable.lods.back().position_offset = lod->position_offset;
+				drawable.lods.back().screen_size = screen_size;
+				screen_size *= 0.5f;
+			}
+		}
+		return ret;
+	};
 });
 
-Load< Sound::Sample > background_loop_sample(LoadTagDefault, []() -> Sound::Sample const* {
-	return new Sound::Sample(data_path("faster-does-it.wav"));
+//(samples need no OpenGL, so they load entirely in the background)
+Load< Sound::Sample > background_loop_sample(LoadTagDefault, LoadInBackground, []() -> std::function< Sound::Sample const *() > {
+	Sound::Sample const *ret = new Sound::Sample(data_path("faster-does-it.wav"));
+	return [ret]() { return ret; };
 });
 
-Load< Sound::Sample > boiling_water_sample(LoadTagDefault, []() -> Sound::Sample const* {
-	return new Sound::Sample(data_path("boiling_water.wav"));
+Load< Sound::Sample > boiling_water_sample(LoadTagDefault, LoadInBackground, []() -> std::function< Sound::Sample const *() > {
+	Sound::Sample const *ret = new Sound::Sample(data_path("boiling_water.wav"));
+	return [ret]() { return ret; };
 });
 
-Load< Sound::Sample > bell_ding_sample(LoadTagDefault, []() -> Sound::Sample const* {
-	return new Sound::Sample(data_path("bell.wav"));
+Load< Sound::Sample > bell_ding_sample(LoadTagDefault, LoadInBackground, []() -> std::function< Sound::Sample const *() > {
+	Sound::Sample const *ret = new Sound::Sample(data_path("bell.wav"));
+	return [ret]() { return ret; };
 });
 
 void PlayMode::update_camera() {
@@ -71,6 +126,7 @@ void PlayMode::update_camera() {
 	// camera looking code sourced from https://learnopengl.com/Getting-started/Camera and https://gamedev.stackexchange.com/questions/149006/direction-vector-to-quaternion
 	glm::mat4 view = glm::lookAt(camera->transform->position, player->position + transformed_cam_offset, camera_up);
 	camera->transform->rotation = glm::conjugate(glm::quat_cast(view));
+	camera->transform->mark_dirty();
 }
 
 bool PlayMode::player_at_spot(glm::vec3 spot) {
@@ -199,6 +255,7 @@ void PlayMode::reset_game() {
 	//reset player position
 	player->position = glm::vec3(0.0f, 0.0f, 0.0f);
 	player->rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	player->mark_dirty();
 	pitch = 0.0f;
 	yaw = 0.0f;
 	player_yaw = 0.0f;
@@ -208,47 +265,65 @@ void PlayMode::reset_game() {
 
 
 PlayMode::PlayMode() : scene(*level_scene) {
-	for (auto& transform : scene.transforms) {
-		if (transform.name == "Player") player = &transform;
-		else if (transform.name == "EmptyBowl") bowls[0] = &transform;
-		else if (transform.name == "EmptyBowl1") bowls[1] = &transform;
-		else if (transform.name == "EmptyBowl2") bowls[2] = &transform;
-		else if (transform.name == "BowlUncookedRice") bowl_uncooked_rices[0] = &transform;
-		else if (transform.name == "BowlUncookedRice1") bowl_uncooked_rices[1] = &transform;
-		else if (transform.name == "BowlUncookedRice2") bowl_uncooked_rices[2] = &transform;
-		else if (transform.name == "BowlCookedRice") bowl_cooked_rices[0] = &transform;
-		else if (transform.name == "BowlCookedRice1") bowl_cooked_rices[1] = &transform;
-		else if (transform.name == "BowlCookedRice2") bowl_cooked_rices[2] = &transform;
-		else if (transform.name == "BowlBurntRice") bowl_burnt_rices[0] = &transform;
-		else if (transform.name == "BowlBurntRice1") bowl_burnt_rices[1] = &transform;
-		else if (transform.name == "BowlBurntRice2") bowl_burnt_rices[2] = &transform;
+	//look up objects through the scene's name index:
+	auto find = [this](std::string const &name) -> Scene::Transform * {
+		Scene::Transform *transform = scene.find_transform(name);
+		if (transform == nullptr) throw std::runtime_error("GameObject '" + name + "' not found.");
+		return transform;
+	};
+	player = find("Player");
+	for (uint32_t i = 0; i < 3; ++i) {
+		std::string suffix = (i == 0 ? "" : std::to_string(i));
+		bowls[i] = find("EmptyBowl" + suffix);
+		bowl_uncooked_rices[i] = find("BowlUncookedRice" + suffix);
+		bowl_cooked_rices[i] = find("BowlCookedRice" + suffix);
+		bowl_burnt_rices[i] = find("BowlBurntRice" + suffix);
 	}
-	if (player == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowls[0] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowls[1] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowls[2] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_uncooked_rices[0] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_uncooked_rices[1] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_uncooked_rices[2] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_cooked_rices[0] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_cooked_rices[1] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_cooked_rices[2] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_burnt_rices[0] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_burnt_rices[1] == nullptr) throw std::runtime_error("GameObject not found.");
-	if (bowl_burnt_rices[2] == nullptr) throw std::runtime_error("GameObject not found.");
 
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
 	camera = &scene.cameras.front();
 
+	//everything but the player and bowls stays put, so merge it into static batches:
+	std::vector< Scene::Transform const * > moving{ player };
+	for (auto const &list : { bowls, bowl_uncooked_rices, bowl_cooked_rices, bowl_burnt_rices }) {
+		moving.insert(moving.end(), list, list + 3);
+	}
+	for (auto &drawable : scene.drawables) {
+		drawable.static_geometry = true;
+		for (Scene::Transform const *t = drawable.transform; t; t = t->parent) {
+			if (std::find(moving.begin(), moving.end(), t) != moving.end()) drawable.static_geometry = false;
+		}
+	}
+	static_batches = bake_static_drawables(scene, *level_meshes, data_path("level1.baked"));
+
+	//the counter hides whatever is behind it, so use its mesh as an occluder:
+	Scene::Transform *counter = find("Counter");
+	for (auto const *list : { &scene.drawables, &scene.baked_drawables }) {
+		for (auto const &drawable : *list) {
+			if (drawable.transform != counter || drawable.pipeline.type != GL_TRIANGLES) continue;
+			auto triangles = std::make_shared< std::vector< glm::vec3 > >();
+			for (uint32_t e = drawable.pipeline.start; e < drawable.pipeline.start + drawable.pipeline.count; ++e) {
+				uint32_t v = level_meshes->element_vertex(drawable.pipeline.index_type, drawable.pipeline.base_vertex, e);
+				triangles->emplace_back(level_meshes->vertices[v].Position);
+			}
+			scene.occluders.emplace_back(counter);
+			scene.occluders.back().triangles = triangles;
+		}
+	}
+
+	//world matrices are queried several times a frame, so cache them:
+	// (n.b. this means transforms edited below must be marked dirty)
+	scene.set_cache_world(true);
+
 	for (Scene::Transform* bowl : bowls)
-		bowl->position = off_screen;
+		bowl->set_position(off_screen);
 	for (Scene::Transform* bowl : bowl_uncooked_rices)
-		bowl->position = off_screen;
+		bowl->set_position(off_screen);
 	for (Scene::Transform* bowl : bowl_cooked_rices)
-		bowl->position = off_screen;
+		bowl->set_position(off_screen);
 	for (Scene::Transform* bowl : bowl_burnt_rices)
-		bowl->position = off_screen;
+		bowl->set_position(off_screen);
 
 	update_camera();
 
@@ -354,6 +429,7 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 		camera->transform->position.x = cos(yaw) * camera_dist + player->position.x + transformed_cam_offset.x;
 		camera->transform->position.y = sin(yaw) * camera_dist + player->position.y + transformed_cam_offset.y;
 		camera->transform->position.z = sin(pitch) * camera_dist + player->position.z + transformed_cam_offset.z;
+		camera->transform->mark_dirty();
 		return true;
 	}
 
@@ -432,6 +508,7 @@ void PlayMode::update(float elapsed) {
 		player->rotation.w = cos(player_yaw / 2.0f);
 		player->rotation.z = sin(player_yaw / 2.0f);
 	}
+	player->mark_dirty();
 
 	{ //update listener to camera position:
 		glm::mat4x3 frame = player->make_local_to_world();
@@ -455,7 +532,7 @@ void PlayMode::update(float elapsed) {
 			int bowl_idx = get_available_bowl_uncooked();
 			if (bowl_idx != -1) {
 				held_item = BOWL_UNCOOKED_RICE;
-				held_item_obj->position = off_screen;
+				held_item_obj->set_position(off_screen);
 				held_item_obj = bowl_uncooked_rices[bowl_idx];
 			}
 		}
@@ -463,7 +540,7 @@ void PlayMode::update(float elapsed) {
 			int bowl_idx = get_available_bowl();
 			if (bowl_idx != -1) {
 				held_item = BOWL;
-				held_item_obj->position = off_screen;
+				held_item_obj->set_position(off_screen);
 				held_item_obj = bowls[bowl_idx];
 				rice_states[rice_spot].state = UNREADY;
 				rice_states[rice_spot].timer = 0.0f;
@@ -474,7 +551,7 @@ void PlayMode::update(float elapsed) {
 			int bowl_idx = get_available_bowl_cooked();
 			if (bowl_idx != -1) {
 				held_item = BOWL_COOKED_RICE;
-				held_item_obj->position = off_screen;
+				held_item_obj->set_position(off_screen);
 				held_item_obj = bowl_cooked_rices[bowl_idx];
 				boiling_water[rice_spot]->stop();
 				rice_states[rice_spot].state = STATE_NONE;
@@ -484,7 +561,7 @@ void PlayMode::update(float elapsed) {
 			int bowl_idx = get_available_bowl_burnt();
 			if (bowl_idx != -1) {
 				held_item = BOWL_BURNT_RICE;
-				held_item_obj->position = off_screen;
+				held_item_obj->set_position(off_screen);
 				held_item_obj = bowl_burnt_rices[bowl_idx];
 				boiling_water[rice_spot]->stop();
 				rice_states[rice_spot].state = STATE_NONE;
@@ -492,7 +569,7 @@ void PlayMode::update(float elapsed) {
 		}
 		else if (held_item == BOWL_COOKED_RICE && player_at_spot(delivery_point)) {
 			held_item = ITEM_NONE;
-			held_item_obj->position = off_screen;
+			held_item_obj->set_position(off_screen);
 			held_item_obj = nullptr;
 			complete_ticket(RICE);
 			bowls_out--;
@@ -500,7 +577,7 @@ void PlayMode::update(float elapsed) {
 		else if (player_at_spot(trash_can) && held_item != ITEM_NONE && held_item != BOWL) {
 			int bowl_idx = get_available_bowl();
 			if (bowl_idx != -1) {
-				held_item_obj->position = off_screen;
+				held_item_obj->set_position(off_screen);
 				held_item = BOWL;
 				held_item_obj = bowls[bowl_idx];
 			}
@@ -508,7 +585,14 @@ void PlayMode::update(float elapsed) {
 	}
 	
 	if (held_item_obj != nullptr)
-		held_item_obj->position = player_hold;
+		held_item_obj->set_position(player_hold);
+
+	//recompute packed world matrices of the transforms moved above (re-packing after the bake's new transform, the first time):
+	// (no update_pool -- the level is far smaller than update_transforms()' chunks, so threads wouldn't help)
+	scene.update_transforms();
+
+	//refit the drawable BVH (used to cull in Scene::draw) to objects moved above:
+	scene.update_drawable_bvh();
 
 	// update timers
 	update_rice_cookers(elapsed);
@@ -530,35 +614,42 @@ void PlayMode::update(float elapsed) {
 }
 
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
+	//(draws exactly what record() would, right away)
+	RenderCommands commands;
+	glGetIntegerv(GL_VIEWPORT, glm::value_ptr(commands.viewport));
+	record(drawable_size, &commands);
+	commands.execute();
+}
+
+void PlayMode::record(glm::uvec2 const &drawable_size, RenderCommands *commands) {
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-	glUseProgram(0);
+	//set up the global light (shared by all programs via the "Frame" uniform block):
+	// (point and spot lights in the scene are added per-cluster by scene.record -- see Scene::light_clusters)
+	scene.frame_uniforms.light_type = 1;
+	scene.frame_uniforms.light_direction = glm::vec3(0.0f, 0.0f,-1.0f);
+	scene.frame_uniforms.light_energy = glm::vec3(1.0f, 1.0f, 0.95f);
 
-	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	//(1.0 is actually the default value to clear the depth buffer to, but FYI you can change it)
+	commands->clear_buffers(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f), 1.0f);
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
+	commands->enable(GL_DEPTH_TEST);
+	commands->depth_func(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
 
-	scene.draw(*camera);
+	scene.record(*camera, commands);
 
 	{ //use DrawLines to overlay some text:
-		glDisable(GL_DEPTH_TEST);
+		commands->disable(GL_DEPTH_TEST);
 		float aspect = float(drawable_size.x) / float(drawable_size.y);
-		DrawLines lines(glm::mat4(
+		//(DrawLines only touches OpenGL when destroyed, so it can be filled in here and destroyed when the commands run)
+		std::shared_ptr< DrawLines > lines_ptr = std::make_shared< DrawLines >(glm::mat4(
 			1.0f / aspect, 0.0f, 0.0f, 0.0f,
 			0.0f, 1.0f, 0.0f, 0.0f,
 			0.0f, 0.0f, 1.0f, 0.0f,
 			0.0f, 0.0f, 0.0f, 1.0f
 		));
+		DrawLines &lines = *lines_ptr;
 
 		constexpr float H = 0.15f;
 		if (player_at_spot(delivery_point)) {
@@ -615,5 +706,9 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 			glm::vec3(0.65 * aspect, 1.0 - 1.1f * H, 0.0),
 			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+
+		commands->callback([lines_ptr]() mutable {
+			lines_ptr.reset();
+		});
 	}
 }
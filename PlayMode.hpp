@@ -7,8 +7,11 @@
 
 #include <vector>
 #include <deque>
+#include <memory>
 #include <random>
 
+struct MeshBuffer;
+
 struct PlayMode : Mode {
 	PlayMode();
 	virtual ~PlayMode();
@@ -17,6 +20,7 @@ struct PlayMode : Mode {
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
 	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
+	virtual void record(glm::uvec2 const &drawable_size, RenderCommands *commands) override;
 
 	//helper functions
 	void update_camera();
@@ -45,6 +49,9 @@ struct PlayMode : Mode {
 	//local copy of the game scene (so code can change it during gameplay):
 	Scene scene;
 
+	//merged geometry of the scene's non-moving drawables (see bake_static_drawables()):
+	std::unique_ptr< MeshBuffer > static_batches;
+
 	Scene::Transform* player = nullptr;
 	Scene::Transform* bowls[3] = { nullptr, nullptr, nullptr };
 	Scene::Transform* bowl_uncooked_rices[3] = { nullptr, nullptr, nullptr };
@@ -2,61 +2,45 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "ThreadPool.hpp"
+#include "make_trs.hpp"
+#include "mapped_file.hpp"
+#include "Mesh.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include <fstream>
+#include <streambuf>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
 
 //-------------------------
 
 glm::mat4x3 Scene::Transform::make_local_to_parent() const {
-	//compute:
-	//   translate   *   rotate    *   scale
-	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
-	// [ 0 1 0 p.y ] * [ rot   0 ] * [ 0 s.y 0 0 ]
-	// [ 0 0 1 p.z ]   [       0 ]   [ 0 0 s.z 0 ]
-	//                 [ 0 0 0 1 ]   [ 0 0   0 1 ]
-
-	glm::mat3 rot = glm::mat3_cast(rotation);
-	return glm::mat4x3(
-		rot[0] * scale.x, //scaling the columns here means that scale happens before rotation
-		rot[1] * scale.y,
-		rot[2] * scale.z,
-		position
-	);
+	return make_trs(position, rotation, scale);
 }
 
 glm::mat4x3 Scene::Transform::make_parent_to_local() const {
-	//compute:
-	//   1/scale       *    rot^-1   *  translate^-1
-	// [ 1/s.x 0 0 0 ]   [       0 ]   [ 0 0 0 -p.x ]
-	// [ 0 1/s.y 0 0 ] * [rot^-1 0 ] * [ 0 0 0 -p.y ]
-	// [ 0 0 1/s.z 0 ]   [       0 ]   [ 0 0 0 -p.z ]
-	//                   [ 0 0 0 1 ]   [ 0 0 0  1   ]
-
-	glm::vec3 inv_scale;
-	//taking some care so that we don't end up with NaN's , just a degenerate matrix, if scale is zero:
-	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
-	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
-	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
-
-	//compute inverse of rotation:
-	glm::mat3 inv_rot = glm::mat3_cast(glm::inverse(rotation));
-
-	//scale the rows of rot:
-	inv_rot[0] *= inv_scale;
-	inv_rot[1] *= inv_scale;
-	inv_rot[2] *= inv_scale;
-
-	return glm::mat4x3(
-		inv_rot[0],
-		inv_rot[1],
-		inv_rot[2],
-		inv_rot * -position
-	);
+	return make_inverse_trs(position, rotation, scale);
 }
 
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
+	if (packed && !packed->pending && !packed->needs_repack) {
+		return packed->local_to_world[packed_index];
+	}
+	if (cache_world) {
+		if (local_to_world_dirty) {
+			if (!parent) {
+				cached_local_to_world = make_local_to_parent();
+			} else {
+				cached_local_to_world = parent->make_local_to_world() * glm::mat4(make_local_to_parent());
+			}
+			local_to_world_dirty = false;
+		}
+		return cached_local_to_world;
+	}
 	if (!parent) {
 		return make_local_to_parent();
 	} else {
@@ -64,6 +48,20 @@ glm::mat4x3 Scene::Transform::make_local_to_world() const {
 	}
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
+	if (packed && !packed->pending && !packed->needs_repack) {
+		return packed->world_to_local[packed_index];
+	}
+	if (cache_world) {
+		if (world_to_local_dirty) {
+			if (!parent) {
+				cached_world_to_local = make_parent_to_local();
+			} else {
+				cached_world_to_local = make_parent_to_local() * glm::mat4(parent->make_world_to_local());
+			}
+			world_to_local_dirty = false;
+		}
+		return cached_world_to_local;
+	}
 	if (!parent) {
 		return make_parent_to_local();
 	} else {
@@ -71,6 +69,257 @@ glm::mat4x3 Scene::Transform::make_world_to_local() const {
 	}
 }
 
+void Scene::Transform::set_position(glm::vec3 const &position_) {
+	position = position_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_rotation(glm::quat const &rotation_) {
+	rotation = rotation_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &scale_) {
+	scale = scale_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_parent(Transform *parent_) {
+	if (parent == parent_) return;
+
+	//remove from old parent's child list:
+	if (parent) {
+		auto f = std::find(parent->children.begin(), parent->children.end(), this);
+		assert(f != parent->children.end());
+		parent->children.erase(f);
+	}
+
+	parent = parent_;
+
+	if (parent) {
+		parent->children.emplace_back(this);
+	}
+
+	if (packed) {
+		//the packed order only needs to change if the new parent comes later:
+		if (!parent) {
+			packed->parents[packed_index] = -1U;
+		} else if (parent->packed == packed && parent->packed_index < packed_index) {
+			packed->parents[packed_index] = parent->packed_index;
+		} else {
+			packed->needs_repack = true;
+		}
+	}
+
+	mark_dirty();
+}
+
+void Scene::Transform::mark_dirty() {
+	if (packed) {
+		//write through to packed storage:
+		packed->positions[packed_index] = position;
+		packed->rotations[packed_index] = rotation;
+		packed->scales[packed_index] = scale;
+		packed->dirty[packed_index] = 1;
+		packed->pending = true;
+	}
+
+	//if already dirty, all descendants are also dirty, so no need to visit them:
+	// (only true of caching transforms -- others never clear their flags, but may have caching descendants)
+	if (cache_world && local_to_world_dirty && world_to_local_dirty) return;
+
+	local_to_world_dirty = true;
+	world_to_local_dirty = true;
+	for (Transform *child : children) {
+		child->mark_dirty();
+	}
+}
+
+//-------------------------
+
+void Scene::TransformArrays::clear() {
+	for (Transform *t : transforms) {
+		t->packed = nullptr;
+		t->packed_index = -1U;
+	}
+	active = false;
+	positions.clear();
+	rotations.clear();
+	scales.clear();
+	parents.clear();
+	local_to_world.clear();
+	world_to_local.clear();
+	dirty.clear();
+	transforms.clear();
+	handle_index.clear();
+	level_begin.clear();
+	pending = false;
+	needs_repack = false;
+}
+
+void Scene::pack_transforms() {
+	packed.clear();
+
+	//sort transforms by depth, which puts parents before children:
+	// (the sort is stable, so a hierarchy that is already in topological order -- as
+	//  Scene::load produces -- keeps its order within each level)
+	std::vector< std::pair< uint32_t, Transform * > > order;
+	order.reserve(transforms.size());
+	{
+		std::unordered_map< Transform const *, uint32_t > depth;
+		depth.reserve(transforms.size());
+		std::vector< Transform const * > chain;
+		for (auto &t : transforms) {
+			//walk up until reaching a transform of known depth (or past the root):
+			chain.clear();
+			Transform const *at = &t;
+			while (at && !depth.count(at)) {
+				chain.emplace_back(at);
+				at = at->parent;
+			}
+			uint32_t d = (at ? depth.at(at) + 1 : 0);
+			for (auto c = chain.rbegin(); c != chain.rend(); ++c) {
+				depth.emplace(*c, d);
+				d += 1;
+			}
+			order.emplace_back(depth.at(&t), &t);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [](std::pair< uint32_t, Transform * > const &a, std::pair< uint32_t, Transform * > const &b) {
+		return a.first < b.first;
+	});
+
+	uint32_t count = uint32_t(order.size());
+	packed.active = true;
+	packed.positions.reserve(count);
+	packed.rotations.reserve(count);
+	packed.scales.reserve(count);
+	packed.parents.reserve(count);
+	packed.transforms.reserve(count);
+
+	uint32_t next_handle = 0;
+	for (auto const &o : order) {
+		//start a new level when depth changes:
+		while (packed.level_begin.size() <= o.first) {
+			packed.level_begin.emplace_back(uint32_t(packed.transforms.size()));
+		}
+		Transform *t = o.second;
+		t->packed = &packed;
+		t->packed_index = uint32_t(packed.transforms.size());
+		packed.transforms.emplace_back(t);
+		if (t->handle != -1U) next_handle = std::max(next_handle, t->handle + 1);
+	}
+
+	for (Transform *t : packed.transforms) {
+		if (t->handle == -1U) t->handle = next_handle++;
+
+		uint32_t parent = -1U;
+		if (t->parent) {
+			if (t->parent->packed != &packed) {
+				packed.clear();
+				throw std::runtime_error("transform '" + t->name + "' has a parent that is not part of this scene.");
+			}
+			parent = t->parent->packed_index;
+			assert(parent < t->packed_index);
+		}
+
+		packed.positions.emplace_back(t->position);
+		packed.rotations.emplace_back(t->rotation);
+		packed.scales.emplace_back(t->scale);
+		packed.parents.emplace_back(parent);
+	}
+
+	packed.level_begin.emplace_back(count);
+
+	packed.handle_index.assign(next_handle, -1U);
+	for (Transform *t : packed.transforms) {
+		packed.handle_index[t->handle] = t->packed_index;
+	}
+
+	packed.local_to_world.assign(count, glm::mat4x3(1.0f));
+	packed.world_to_local.assign(count, glm::mat4x3(1.0f));
+	packed.dirty.assign(count, 1);
+	packed.pending = true;
+
+	update_transforms();
+}
+
+//recompute world matrices for packed transforms [begin,end):
+// (parents of these transforms must already be up to date)
+static void update_packed_range(Scene::TransformArrays &packed, uint32_t begin, uint32_t end) {
+	//local matrices are built with the batched (SIMD) kernel a block at a time:
+	constexpr uint32_t Block = 64;
+	glm::mat4x3 local_to_parent[Block];
+	glm::mat4x3 parent_to_local[Block];
+
+	for (uint32_t block = begin; block < end; block += Block) {
+		uint32_t block_end = std::min(end, block + Block);
+
+		//propagate dirtiness from parents (which come earlier):
+		bool any_dirty = false;
+		for (uint32_t i = block; i < block_end; ++i) {
+			uint32_t parent = packed.parents[i];
+			if (parent != -1U) packed.dirty[i] |= packed.dirty[parent];
+			any_dirty = any_dirty || packed.dirty[i];
+		}
+		if (!any_dirty) continue;
+
+		make_trs_batch(block_end - block, &packed.positions[block], &packed.rotations[block], &packed.scales[block], local_to_parent, parent_to_local);
+
+		for (uint32_t i = block; i < block_end; ++i) {
+			if (!packed.dirty[i]) continue;
+			uint32_t parent = packed.parents[i];
+			if (parent == -1U) {
+				packed.local_to_world[i] = local_to_parent[i - block];
+				packed.world_to_local[i] = parent_to_local[i - block];
+			} else {
+				packed.local_to_world[i] = packed.local_to_world[parent] * glm::mat4(local_to_parent[i - block]);
+				packed.world_to_local[i] = parent_to_local[i - block] * glm::mat4(packed.world_to_local[parent]);
+			}
+		}
+	}
+}
+
+void Scene::update_transforms() {
+	if (!packed.active) return;
+	if (packed.needs_repack) {
+		pack_transforms(); //(calls update_transforms() again)
+		return;
+	}
+	if (!packed.pending) return;
+
+	if (!update_pool || update_pool->size() == 1) {
+		//parents come before children, so dirtiness and parent matrices are ready when a child is reached:
+		update_packed_range(packed, 0, packed.size());
+	} else {
+		//transforms within a level only read from earlier levels, so each level can be split across threads:
+		constexpr uint32_t Grain = 256; //transforms per chunk; small levels end up running inline
+		for (uint32_t l = 0; l + 1 < packed.level_begin.size(); ++l) {
+			update_pool->parallel_for(packed.level_begin[l], packed.level_begin[l+1], Grain, [this](uint32_t begin, uint32_t end){
+				update_packed_range(packed, begin, end);
+			});
+		}
+	}
+
+	std::fill(packed.dirty.begin(), packed.dirty.end(), uint8_t(0));
+	packed.pending = false;
+}
+
+Scene::TransformHandle Scene::get_handle(Transform const *transform) const {
+	assert(transform);
+	assert(transform->packed == &packed && "only transforms in packed storage have handles");
+	TransformHandle ret;
+	ret.index = transform->handle;
+	return ret;
+}
+
+Scene::Transform *Scene::get_transform(TransformHandle handle) const {
+	if (handle.index >= packed.handle_index.size()) return nullptr;
+	uint32_t index = packed.handle_index[handle.index];
+	if (index == -1U) return nullptr;
+	return packed.transforms[index];
+}
+
 //-------------------------
 
 glm::mat4 Scene::Camera::make_projection() const {
@@ -81,16 +330,278 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 
 void Scene::draw(Camera const &camera) const {
+	draw_commands.clear();
+	glGetIntegerv(GL_VIEWPORT, glm::value_ptr(draw_commands.viewport));
+	record(camera, &draw_commands);
+	draw_commands.execute();
+}
+
+void Scene::record(Camera const &camera, RenderCommands *commands) const {
 	assert(camera.transform);
-	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	assert(commands);
+	glm::mat4 projection = camera.make_projection();
+	glm::mat4x3 world_to_view = camera.transform->make_world_to_local();
+	glm::mat4 world_to_clip = projection * glm::mat4(world_to_view);
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
-	draw(world_to_clip, world_to_light);
+
+	//bin point and spot lights for this view:
+	// (light space is world space here, so light_to_view is just world_to_view)
+	std::vector< LightClusters::Light > &cluster_lights = record_scratch.cluster_lights;
+	cluster_lights.clear();
+	float far = 0.0f; //farthest view depth any light reaches (where the last cluster slice ends)
+	for (auto const &light : lights) {
+		if (light.type != Light::Point && light.type != Light::Spot) continue;
+		glm::mat4x3 to_world = light.transform->make_local_to_world();
+		LightClusters::Light l;
+		l.position = to_world[3];
+		//(shaders light with energy / max(1, distance^2), so this is where that reaches the threshold)
+		float energy = std::max(light.energy.r, std::max(light.energy.g, light.energy.b));
+		l.radius = std::sqrt(std::max(1.0f, energy / light_threshold));
+		l.energy = light.energy;
+		l.type = (light.type == Light::Spot ? 2.0f : 0.0f);
+		l.direction = -glm::normalize(to_world[2]); //(lights point along -z)
+		l.cutoff = std::cos(0.5f * light.spot_fov);
+		cluster_lights.emplace_back(l);
+		far = std::max(far, -(world_to_view * glm::vec4(l.position, 1.0f)).z + l.radius);
+	}
+	light_clusters.build(cluster_lights, world_to_view, projection, camera.near, far);
+	commands->upload_clusters(&light_clusters);
+
+	record(world_to_clip, world_to_light, &light_clusters, commands);
+}
+
+bool Scene::box_in_frustum(glm::mat4 const &to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	//Frustum planes come from sums/differences of rows of the clip matrix (Gribb & Hartmann).
+	// A box is outside if it is entirely on the negative side of any plane:
+	glm::vec3 center = 0.5f * (max + min);
+	glm::vec3 radius = 0.5f * (max - min);
+
+	glm::mat4 rows = glm::transpose(to_clip);
+	for (uint32_t i = 0; i < 3; ++i) {
+		for (float sign : {1.0f, -1.0f}) {
+			glm::vec4 plane = rows[3] + sign * rows[i]; //w + x >= 0, w - x >= 0, etc.
+			float dist = glm::dot(glm::vec3(plane), center) + plane.w;
+			float extent = glm::dot(glm::abs(glm::vec3(plane)), radius);
+			if (dist + extent < 0.0f) return false;
+		}
+	}
+	return true;
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+//world-space bounding box of a drawable's local bounds:
+static BVH::Box world_bounds(Scene::Drawable const &drawable) {
+	BVH::Box box;
+	if (!(drawable.min.x <= drawable.max.x)) return box; //(empty)
+
+	glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+	glm::vec3 center = object_to_world * glm::vec4(0.5f * (drawable.max + drawable.min), 1.0f);
+	glm::vec3 radius = 0.5f * (drawable.max - drawable.min);
+	glm::vec3 world_radius =
+		  glm::abs(object_to_world[0]) * radius.x
+		+ glm::abs(object_to_world[1]) * radius.y
+		+ glm::abs(object_to_world[2]) * radius.z;
+	box.min = center - world_radius;
+	box.max = center + world_radius;
+	return box;
+}
 
-	//Iterate through all drawables, sending each one to OpenGL:
+void Scene::update_drawable_bvh() {
+	//check if the BVH's items still match the drawables list:
+	bool rebuild = (bvh_drawables.size() != drawables.size());
+	if (!rebuild) {
+		uint32_t i = 0;
+		for (auto const &drawable : drawables) {
+			if (bvh_drawables[i] != &drawable) {
+				rebuild = true;
+				break;
+			}
+			++i;
+		}
+	}
+
+	if (!rebuild) {
+		//refit items whose world bounds changed:
+		uint32_t i = 0;
+		for (auto const &drawable : drawables) {
+			BVH::Box box = world_bounds(drawable);
+			uint32_t leaf = drawable_bvh.item_leaf[i];
+			if (leaf == -1U || box.empty()) {
+				//bounds went from empty to non-empty (or back); tree needs a new leaf:
+				if (leaf != -1U || !box.empty()) {
+					rebuild = true;
+					break;
+				}
+			} else {
+				BVH::Box const &old = drawable_bvh.nodes[leaf].box;
+				if (box.min != old.min || box.max != old.max) drawable_bvh.refit(i, box);
+			}
+			++i;
+		}
+		if (!rebuild && !drawable_bvh.needs_rebuild()) return;
+	}
+
+	bvh_drawables.clear();
+	bvh_drawables.reserve(drawables.size());
+	std::vector< BVH::Box > boxes;
+	boxes.reserve(drawables.size());
+	for (auto &drawable : drawables) {
+		bvh_drawables.emplace_back(&drawable);
+		boxes.emplace_back(world_bounds(drawable));
+	}
+	drawable_bvh.build(boxes);
+}
+
+void Scene::find_drawables(glm::vec3 const &min, glm::vec3 const &max, std::function< void(Drawable &) > const &fn) const {
+	drawable_bvh.query_box(min, max, [&](uint32_t item) {
+		fn(*bvh_drawables[item]);
+	});
+}
+
+Scene::Drawable *Scene::raycast_drawables(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *t_) const {
+	Drawable *hit = nullptr;
+	drawable_bvh.query_ray(origin, direction, max_t, [&](uint32_t item, float t) {
+		hit = bvh_drawables[item];
+		if (t_) *t_ = t;
+		return t; //only look for nearer hits from now on
+	});
+	return hit;
+}
+
+GLuint Scene::instance_buffer() {
+	static GLuint buffer = 0;
+	if (buffer == 0) glGenBuffers(1, &buffer);
+	return buffer;
+}
+
+//Draw packets are sorted by a 64-bit key, most significant bits first:
+//  [63:54] program, [53:44] vertex array, [43:32] texture set -- so packets sharing state end up adjacent
+//  [31:20] mesh (type/start/count/instanced pipeline) -- so copies of the same mesh end up adjacent (for instancing)
+//  [19:0] view depth -- so packets within the same state draw front-to-back (helps early-z)
+// (program/vertex array/texture set/mesh are numbered by their place among the frame's distinct values)
+typedef Scene::DrawPacket DrawPacket;
+typedef Scene::DrawSortEntry DrawSortEntry;
+
+//compose an object-space matrix 'm' with the mapping from compact vertex positions to object space:
+// (i.e., m * translate(offset) * scale(scale), without the extra multiplies)
+template< typename M >
+static M fold_position_scale(M m, glm::vec3 const &scale, glm::vec3 const &offset) {
+	m[3] = m * glm::vec4(offset, 1.0f);
+	m[0] *= scale.x;
+	m[1] *= scale.y;
+	m[2] *= scale.z;
+	return m;
+}
+
+//least-significant-digit radix sort, eight bits at a time; skips digits all keys share:
+// ('temp' is working storage, swapped with 'entries' as digits are sorted)
+static void radix_sort(std::vector< DrawSortEntry > &entries, std::vector< DrawSortEntry > &temp) {
+	temp.resize(entries.size());
+	for (uint32_t shift = 0; shift < 64; shift += 8) {
+		uint32_t counts[256] = { 0 };
+		for (auto const &e : entries) {
+			counts[(e.key >> shift) & 0xff] += 1;
+		}
+		if (counts[(entries[0].key >> shift) & 0xff] == entries.size()) continue;
+
+		uint32_t offsets[256];
+		uint32_t total = 0;
+		for (uint32_t i = 0; i < 256; ++i) {
+			offsets[i] = total;
+			total += counts[i];
+		}
+		for (auto const &e : entries) {
+			temp[offsets[(e.key >> shift) & 0xff]++] = e;
+		}
+		entries.swap(temp);
+	}
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, LightClusters const *clusters) const {
+	draw_commands.clear();
+	glGetIntegerv(GL_VIEWPORT, glm::value_ptr(draw_commands.viewport));
+	record(world_to_clip, world_to_light, clusters, &draw_commands);
+	draw_commands.execute();
+}
+
+void Scene::record(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, LightClusters const *clusters, RenderCommands *commands) const {
+	assert(commands);
+	draw_stats = DrawStats();
+
+	//if the drawable BVH is in sync with 'drawables', use it to find the possibly-visible ones:
+	std::vector< uint8_t > &bvh_visible = record_scratch.bvh_visible;
+	bvh_visible.clear();
+	if (bvh_drawables.size() == drawables.size() && !drawables.empty()) {
+		bool in_sync = true;
+		uint32_t i = 0;
+		for (auto const &drawable : drawables) {
+			if (bvh_drawables[i] != &drawable) {
+				in_sync = false;
+				break;
+			}
+			++i;
+		}
+		if (in_sync) {
+			bvh_visible.assign(drawables.size(), 0);
+			drawable_bvh.query_frustum(world_to_clip, [&bvh_visible](uint32_t item) {
+				bvh_visible[item] = 1;
+			});
+			//drawables without bounds are not in the tree, and are never culled:
+			for (uint32_t item = 0; item < drawable_bvh.item_leaf.size(); ++item) {
+				if (drawable_bvh.item_leaf[item] == -1U) bvh_visible[item] = 1;
+			}
+		}
+	}
+
+	//rasterize occluders for occlusion culling:
+	bool occlusion = (occlusion_culling && !occluders.empty());
+	if (occlusion) {
+		occlusion_buffer.clear();
+		for (auto const &occluder : occluders) {
+			if (!occluder.triangles || occluder.triangles->empty()) continue;
+			glm::mat4 object_to_clip = world_to_clip * glm::mat4(occluder.transform->make_local_to_world());
+			occlusion_buffer.add_occluder(object_to_clip, occluder.triangles->data(), uint32_t(occluder.triangles->size()));
+		}
+	}
+
+	//projected size scale for level-of-detail selection:
+	// (for a perspective world_to_clip = projection * view, the y row's xyz is the view y axis scaled by projection[1][1])
+	float lod_scale = glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
+
+	//Build a packet for every visible drawable:
+	std::vector< DrawPacket > &packets = record_scratch.packets;
+	std::vector< glm::uvec2 > &ranges = record_scratch.ranges;
+	std::vector< DrawSortEntry > &entries = record_scratch.entries;
+	packets.clear();
+	ranges.clear();
+	entries.clear();
+
+	//state that goes into the sort key (gathered while building packets; numbered once they are all built):
+	record_scratch.programs.clear();
+	record_scratch.vaos.clear();
+	record_scratch.texture_sets.clear();
+	record_scratch.meshes.clear();
+	auto texture_set = [](Drawable::Pipeline const &pipeline) {
+		TextureSet textures;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			textures[i] = pipeline.textures[i].texture;
+		}
+		return textures;
+	};
+	//(instanced pipeline is part of mesh identity, so drawables that can't be instanced don't split up runs of ones that can)
+	auto mesh_key = [](DrawPacket const &packet) {
+		Drawable::Pipeline const &pipeline = packet.drawable->pipeline;
+		bool instanceable = (pipeline.instanced.program != 0 && pipeline.instanced.vao != 0 && !pipeline.set_uniforms);
+		return MeshKey{{
+			pipeline.type, pipeline.index_type, packet.start, packet.count, packet.base_vertex,
+			(instanceable ? pipeline.instanced.program : 0), (instanceable ? pipeline.instanced.vao : 0)
+		}};
+	};
+
+	uint32_t index = 0;
 	for (auto const &drawable : drawables) {
+		bool bvh_culled = (!bvh_visible.empty() && !bvh_visible[index]);
+		index += 1;
+
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
@@ -101,79 +612,315 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
 
+		//skip drawables the BVH query found to be out of view:
+		if (bvh_culled) {
+			draw_stats.culled += 1;
+			continue;
+		}
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
-
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
-
-		//Configure program uniforms:
-
-		//the object-to-world matrix is used in all three of these uniforms:
+		//the object-to-world matrix is used for culling and in all three of the uniforms below:
 		assert(drawable.transform); //drawables *must* have a transform
 		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+		//skip any drawables with bounds that are entirely out of view:
+		// (before touching any OpenGL state)
+		bool has_bounds = (drawable.min.x <= drawable.max.x);
+		if (has_bounds && !box_in_frustum(object_to_clip, drawable.min, drawable.max)) {
+			draw_stats.culled += 1;
+			continue;
+		}
+		//..or that are hidden behind occluders:
+		if (occlusion && has_bounds && !occlusion_buffer.box_visible(object_to_clip, drawable.min, drawable.max)) {
+			draw_stats.occluded += 1;
+			continue;
 		}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
-
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+		//view depth (clip w) of bounds center, clamped so the float bits sort like the value:
+		// (only the top 20 bits -- sign, exponent, and 11 bits of mantissa -- make it into the key)
+		glm::vec3 center = (has_bounds ? 0.5f * (drawable.min + drawable.max) : glm::vec3(0.0f));
+		float depth = std::max(0.0f, object_to_clip[0][3] * center.x + object_to_clip[1][3] * center.y + object_to_clip[2][3] * center.z + object_to_clip[3][3]);
+		uint32_t depth_bits;
+		static_assert(sizeof(depth_bits) == sizeof(depth), "float is 32 bits");
+		std::memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+		//pick a level of detail from the projected size of the bounds:
+		GLuint start = pipeline.start;
+		GLuint count = pipeline.count;
+		GLuint base_vertex = pipeline.base_vertex;
+		glm::vec3 position_scale = pipeline.position_scale;
+		glm::vec3 position_offset = pipeline.position_offset;
+		bool full_detail = true;
+		if (has_bounds && !drawable.lods.empty()) {
+			glm::mat3 m = glm::mat3(object_to_world);
+			float scale = std::max(std::max(glm::length(m[0]), glm::length(m[1])), glm::length(m[2]));
+			float radius = 0.5f * glm::length(drawable.max - drawable.min) * scale;
+
+			uint32_t lod = 0;
+			if (depth > radius) {
+				float size = radius * lod_scale / depth;
+				auto level_for = [&drawable](float size) {
+					uint32_t level = 0;
+					while (level < drawable.lods.size() && size < drawable.lods[level].screen_size) ++level;
+					return level;
+				};
+				//stay at the current level unless the size is clearly past a threshold:
+				uint32_t finest = level_for(size * (1.0f + lod_hysteresis));
+				uint32_t coarsest = level_for(size * (1.0f - lod_hysteresis));
+				lod = std::min(std::max(drawable.lod, finest), coarsest);
+			}
+			drawable.lod = lod;
+			if (lod != 0) {
+				full_detail = false;
+				start = drawable.lods[lod-1].start;
+				count = drawable.lods[lod-1].count;
+				base_vertex = drawable.lods[lod-1].base_vertex;
+				position_scale = drawable.lods[lod-1].position_scale;
+				position_offset = drawable.lods[lod-1].position_offset;
+				draw_stats.lod_drawn += 1;
+			}
 		}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+		//cull the mesh's clusters one by one, merging the index ranges of adjacent visible ones:
+		uint32_t ranges_begin = uint32_t(ranges.size());
+		if (drawable.clusters && drawable.cluster_count != 0 && pipeline.index_type != 0 && full_detail) {
+			for (uint32_t c = 0; c < drawable.cluster_count; ++c) {
+				MeshCluster const &cluster = drawable.clusters[c];
+				bool visible = box_in_frustum(object_to_clip, cluster.min, cluster.max);
+				if (visible && occlusion && !occlusion_buffer.box_visible(object_to_clip, cluster.min, cluster.max)) visible = false;
+				if (!visible) {
+					draw_stats.clusters_culled += 1;
+					continue;
+				}
+				if (ranges.size() > ranges_begin && ranges.back().x + ranges.back().y == cluster.index_begin) {
+					ranges.back().y += cluster.index_end - cluster.index_begin;
+				} else {
+					ranges.emplace_back(cluster.index_begin, cluster.index_end - cluster.index_begin);
+				}
+			}
+			if (ranges.size() == ranges_begin) {
+				//(every cluster was culled)
+				draw_stats.culled += 1;
+				continue;
+			}
+			if (ranges.size() == ranges_begin + 1) {
+				//one range can be drawn (and instanced) like any other:
+				start = ranges.back().x;
+				count = ranges.back().y;
+				ranges.pop_back();
+			}
 		}
+		draw_stats.drawn += 1;
+
+		DrawSortEntry entry;
+		entry.key = uint64_t(depth_bits >> 12); //(state bits are filled in below)
+		entry.packet = uint32_t(packets.size());
+		entries.emplace_back(entry);
+		packets.emplace_back(DrawPacket{ &drawable, object_to_world, object_to_clip, start, count, base_vertex, position_scale, position_offset, ranges_begin, uint32_t(ranges.size()) });
+
+		record_scratch.programs.emplace_back(pipeline.program);
+		record_scratch.vaos.emplace_back(pipeline.vao);
+		record_scratch.texture_sets.emplace_back(texture_set(pipeline));
+		record_scratch.meshes.emplace_back(mesh_key(packets.back()));
+	}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+	//number the distinct values of each kind of state, and fill in the state bits of the keys:
+	// (values past 'limit' all share the last number, so they still sort together, just not by state)
+	auto distinct = [](auto &values) {
+		std::sort(values.begin(), values.end());
+		values.erase(std::unique(values.begin(), values.end()), values.end());
+	};
+	auto rank = [](auto const &values, auto const &value, uint64_t limit) -> uint64_t {
+		return std::min< uint64_t >(std::lower_bound(values.begin(), values.end(), value) - values.begin(), limit);
+	};
+	distinct(record_scratch.programs);
+	distinct(record_scratch.vaos);
+	distinct(record_scratch.texture_sets);
+	distinct(record_scratch.meshes);
+	for (auto &entry : entries) {
+		DrawPacket const &packet = packets[entry.packet];
+		Drawable::Pipeline const &pipeline = packet.drawable->pipeline;
+		entry.key |=
+			  (rank(record_scratch.programs, pipeline.program, 0x3ff) << 54)
+			| (rank(record_scratch.vaos, pipeline.vao, 0x3ff) << 44)
+			| (rank(record_scratch.texture_sets, texture_set(pipeline), 0xfff) << 32)
+			| (rank(record_scratch.meshes, mesh_key(packet), 0xfff) << 20);
+	}
+
+	if (!entries.empty()) radix_sort(entries, record_scratch.sort_temp);
 
-		//set up textures:
+	//set up textures:
+	// (units the pipeline doesn't use are un-bound, as if each drawable were drawn on its own)
+	auto bind_textures = [commands](Drawable::Pipeline const &pipeline) {
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
 			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+				commands->bind_texture(i, pipeline.textures[i].target, pipeline.textures[i].texture);
+			} else {
+				commands->unbind_textures(i);
 			}
 		}
+	};
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
-
-		//un-bind textures:
+	//can packet 'pb' be drawn in the same instanced draw call as packet 'pa'?
+	auto same_instanced = [](DrawPacket const &pa, DrawPacket const &pb) {
+		Drawable::Pipeline const &a = pa.drawable->pipeline;
+		Drawable::Pipeline const &b = pb.drawable->pipeline;
+		if (a.program != b.program || a.vao != b.vao) return false;
+		if (a.type != b.type || pa.start != pb.start || pa.count != pb.count) return false;
+		if (a.index_type != b.index_type || (a.index_type != 0 && pa.base_vertex != pb.base_vertex)) return false;
+		if (pa.position_scale != pb.position_scale || pa.position_offset != pb.position_offset) return false;
+		if (pa.ranges_begin != pa.ranges_end || pb.ranges_begin != pb.ranges_end) return false;
+		if (a.instanced.program != b.instanced.program || a.instanced.vao != b.instanced.vao) return false;
+		if (b.set_uniforms) return false;
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+			if (a.textures[i].texture != b.textures[i].texture) return false;
+			if (a.textures[i].texture != 0 && a.textures[i].target != b.textures[i].target) return false;
 		}
-		glActiveTexture(GL_TEXTURE0);
+		return true;
+	};
 
+	if (entries.empty()) return;
+
+	//"Frame" block (commands->execute() writes it and all "Object" blocks through one mapped range):
+	FrameUniforms frame = frame_uniforms;
+	frame.world_to_clip = world_to_clip;
+	frame.world_to_light = glm::mat4(world_to_light);
+	if (clusters && clusters->stats.lights) {
+		//tiles evenly divide the viewport:
+		glm::ivec4 const &viewport = commands->viewport;
+		frame.cluster_counts = glm::uvec4(LightClusters::TilesX, LightClusters::TilesY, LightClusters::Slices, 0);
+		frame.cluster_tile = glm::vec4(
+			float(LightClusters::TilesX) / float(std::max(1, viewport[2])),
+			float(LightClusters::TilesY) / float(std::max(1, viewport[3])),
+			float(viewport[0]), float(viewport[1])
+		);
+		frame.cluster_depth = glm::vec4(clusters->depth_scale, clusters->depth_bias, 0.0f, 0.0f);
+		commands->bind_clusters(clusters);
+	} else {
+		frame.cluster_counts = glm::uvec4(0);
 	}
+	commands->uniform_block(FrameUniformBinding, &frame, sizeof(frame));
+
+	//Record draw calls in sorted order (runs of matching instanceable packets become one call):
+	// (gl_state drops binds that match the previous call's when the commands are executed)
+	std::vector< InstanceData > &instances = record_scratch.instances;
+	for (uint32_t e = 0; e < entries.size(); /* later */) {
+		DrawPacket const &packet = packets[entries[e].packet];
+		Scene::Drawable::Pipeline const &pipeline = packet.drawable->pipeline;
+
+		//find the run of packets that can be drawn along with this one:
+		uint32_t run_end = e + 1;
+		if (pipeline.instanced.program != 0 && pipeline.instanced.vao != 0 && !pipeline.set_uniforms) {
+			while (run_end < entries.size() && same_instanced(packet, packets[entries[run_end].packet])) {
+				++run_end;
+			}
+		}
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+		if (run_end - e > 1) {
+			//Draw the whole run with one instanced draw call:
+			instances.clear();
+			for (uint32_t i = e; i < run_end; ++i) {
+				DrawPacket const &p = packets[entries[i].packet];
+				instances.emplace_back();
+				InstanceData &instance = instances.back();
+				glm::mat4x3 object_to_light = world_to_light * glm::mat4(p.object_to_world);
+				instance.object_to_clip = fold_position_scale(p.object_to_clip, p.position_scale, p.position_offset);
+				instance.object_to_light = fold_position_scale(object_to_light, p.position_scale, p.position_offset);
+				instance.normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
+			}
+			commands->instances(instances.data(), uint32_t(instances.size() * sizeof(InstanceData)));
 
-	GL_ERRORS();
-}
+			commands->use_program(pipeline.instanced.program);
+			commands->bind_vertex_array(pipeline.instanced.vao);
+			bind_textures(pipeline);
 
+			if (pipeline.index_type != 0) {
+				commands->draw_elements_instanced(pipeline.type, pipeline.index_type, packet.start, packet.count, packet.base_vertex, GLuint(instances.size()));
+			} else {
+				commands->draw_arrays_instanced(pipeline.type, packet.start, packet.count, GLuint(instances.size()));
+			}
+			draw_stats.draw_calls += 1;
+			draw_stats.vertices += packet.count * uint32_t(instances.size());
+			draw_stats.instanced += uint32_t(instances.size());
+			e = run_end;
+			continue;
+		}
+		e = run_end;
 
-void Scene::load(std::string const &filename,
-	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+		//Set shader program:
+		commands->use_program(pipeline.program);
 
-	std::ifstream file(filename, std::ios::binary);
+		//Set attribute sources:
+		commands->bind_vertex_array(pipeline.vao);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+		//the object-to-light matrix is used in the next two uniforms:
+		// (positions get the compact vertex mapping folded in; normals don't, since they aren't scaled)
+		glm::mat4x3 object_to_light = world_to_light * glm::mat4(packet.object_to_world);
+		glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
+		object_to_light = fold_position_scale(object_to_light, packet.position_scale, packet.position_offset);
+		glm::mat4 object_to_clip = fold_position_scale(packet.object_to_clip, packet.position_scale, packet.position_offset);
 
+		//Configure program uniforms:
+		if (pipeline.object_uniform_block) {
+			//matrices go in this drawable's slice of the "Object" block:
+			ObjectUniforms object;
+			object.object_to_clip = object_to_clip;
+			object.object_to_light = glm::mat4(object_to_light);
+			object.normal_to_light = glm::mat3x4(normal_to_light);
+			commands->uniform_block(ObjectUniformBinding, &object, sizeof(object));
+		} else {
+			//OBJECT_TO_CLIP takes vertices from object space to clip space:
+			if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+				commands->uniform(pipeline.OBJECT_TO_CLIP_mat4, object_to_clip);
+			}
+
+			//OBJECT_TO_CLIP takes vertices from object space to light space:
+			if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+				commands->uniform(pipeline.OBJECT_TO_LIGHT_mat4x3, object_to_light);
+			}
+
+			//NORMAL_TO_CLIP takes normals from object space to light space:
+			if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+				commands->uniform(pipeline.NORMAL_TO_LIGHT_mat3, normal_to_light);
+			}
+		}
+
+		//set any requested custom uniforms:
+		if (pipeline.set_uniforms) commands->set_uniforms(&pipeline.set_uniforms);
+
+		bind_textures(pipeline);
+
+		//draw the object:
+		if (packet.ranges_begin != packet.ranges_end) {
+			commands->multi_draw_elements(pipeline.type, pipeline.index_type, ranges.data() + packet.ranges_begin, packet.ranges_end - packet.ranges_begin, packet.base_vertex);
+			for (uint32_t r = packet.ranges_begin; r < packet.ranges_end; ++r) {
+				draw_stats.vertices += ranges[r].y;
+			}
+		} else if (pipeline.index_type != 0) {
+			commands->draw_elements(pipeline.type, pipeline.index_type, packet.start, packet.count, packet.base_vertex);
+			draw_stats.vertices += packet.count;
+		} else {
+			commands->draw_arrays(pipeline.type, packet.start, packet.count);
+			draw_stats.vertices += packet.count;
+		}
+		draw_stats.draw_calls += 1;
+	}
+
+	//(n.b. bindings are left in place -- gl_state knows about them, so later binds can be skipped)
+}
+
+
+namespace {
+	//read-only stream over a range of memory (used to hand the rest of a mapped file to load_extra):
+	struct MemoryStreambuf : std::streambuf {
+		MemoryStreambuf(char const *begin, char const *end) {
+			char *b = const_cast< char * >(begin); //(get area is never written through)
+			setg(b, b, b + (end - begin));
+		}
+	};
+
+	//Scene file records.
+	//version 0 (as written by the blender exporter): "str0" "xfh0" "msh0" "cam0" "lmp0"
 	struct HierarchyEntry {
 		uint32_t parent;
 		uint32_t name_begin;
@@ -183,8 +930,6 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +937,6 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +945,6 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,53 +955,284 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
 
+	//version 1 (as written by Scene::save): "scn1" "str0" "nmo1" "nam1" "xfh1" "msh1" "cam0" "lmp0"
+	// - names are referred to by id; name i is [nmo1[i], nmo1[i+1]) in str0, and nam1 is Scene::name_buckets
+	// - transforms also store their world matrix, and meshes their bounds
+	struct HeaderV1 {
+		uint32_t version; //1
+	};
+	static_assert(sizeof(HeaderV1) == 4, "HeaderV1 is packed.");
+
+	struct HierarchyEntryV1 {
+		uint32_t parent;
+		uint32_t name;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+		glm::mat4x3 local_to_world;
+	};
+	static_assert(sizeof(HierarchyEntryV1) == 4 + 4 + 4*3 + 4*4 + 4*3 + 4*12, "HierarchyEntryV1 is packed.");
+
+	struct MeshEntryV1 {
+		uint32_t transform;
+		uint32_t name;
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(MeshEntryV1) == 4 + 4 + 4*3 + 4*3, "MeshEntryV1 is packed.");
+
+	//Name hash table helpers (shared by the Scene members below and by save()):
+	// 'buckets' is an open-addressed (linear probing) table of ids into 'strings', -1U for empty;
+	// its size is zero or a power of two, and it is kept at most half full.
+	//n.b. this hash is part of the v1 file format -- don't change it:
+	uint32_t hash_name(std::string const &name) {
+		uint32_t hash = 0x811c9dc5; //FNV-1a
+		for (char c : name) {
+			hash = (hash ^ uint8_t(c)) * 0x01000193;
+		}
+		return hash;
+	}
+
+	uint32_t find_name_in(std::vector< std::string > const &strings, std::vector< uint32_t > const &buckets, std::string const &name) {
+		if (buckets.empty()) return -1U;
+		uint32_t mask = uint32_t(buckets.size()) - 1;
+		for (uint32_t b = hash_name(name) & mask; ; b = (b + 1) & mask) {
+			uint32_t id = buckets[b];
+			if (id == -1U) return -1U;
+			if (strings[id] == name) return id;
+		}
+	}
+
+	uint32_t intern_name_in(std::vector< std::string > &strings, std::vector< uint32_t > &buckets, std::string const &name) {
+		uint32_t id = find_name_in(strings, buckets, name);
+		if (id != -1U) return id;
+
+		id = uint32_t(strings.size());
+		strings.emplace_back(name);
+
+		auto insert = [&buckets](uint32_t id, std::string const &name) {
+			uint32_t mask = uint32_t(buckets.size()) - 1;
+			uint32_t b = hash_name(name) & mask;
+			while (buckets[b] != -1U) b = (b + 1) & mask;
+			buckets[b] = id;
+		};
+
+		if (2 * strings.size() > buckets.size()) {
+			//grow (and re-insert everything):
+			size_t size = 16;
+			while (size < 4 * strings.size()) size *= 2;
+			buckets.assign(size, -1U);
+			for (uint32_t i = 0; i < strings.size(); ++i) {
+				insert(i, strings[i]);
+			}
+		} else {
+			insert(id, name);
+		}
+		return id;
+	}
+}
+
+void Scene::load(std::string const &filename,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+
+	//the file is mapped and its records are read in place (rather than copied into temporary buffers):
+	MappedFile file(filename);
+	char const *at = file.begin();
+
+	//version 1 files start with a "scn1" chunk (version 0 files start with "str0"):
+	bool v1 = (file.size >= 4 && std::string(file.data, 4) == "scn1");
 
-	//--------------------------------
-	//Now that file is loaded, create transforms for hierarchy entries:
+	ChunkView< char > names;
+	ChunkView< CameraEntry > cameras;
+	ChunkView< LightEntry > lights;
 
 	std::vector< Transform * > hierarchy_transforms;
-	hierarchy_transforms.reserve(hierarchy.size());
 
-	for (auto const &h : hierarchy) {
-		transforms.emplace_back();
-		Transform *t = &transforms.back();
-		if (h.parent != -1U) {
-			if (h.parent >= hierarchy_transforms.size()) {
-				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
+	//call on_drawable, then fill in what's known about the drawables it made:
+	auto add_drawable = [&](Transform *transform, uint32_t name_id, glm::vec3 const *min, glm::vec3 const *max) {
+		if (!on_drawable) return;
+		size_t before = drawables.size();
+		on_drawable(*this, transform, name_strings[name_id]);
+		auto d = drawables.rbegin();
+		for (size_t i = before; i < drawables.size(); ++i, ++d) {
+			d->mesh_name_id = name_id;
+			if (min && max) {
+				d->min = *min;
+				d->max = *max;
 			}
-			t->parent = hierarchy_transforms[h.parent];
 		}
+	};
 
-		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
-		} else {
-				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
+	if (!v1) {
+		view_chunk(&at, file.end(), "str0", &names);
+		//names are [name_begin, name_end) ranges of the str0 chunk:
+		auto get_name = [&names](uint32_t name_begin, uint32_t name_end) {
+			return std::string(names.data + name_begin, names.data + name_end);
+		};
+
+		ChunkView< HierarchyEntry > hierarchy;
+		view_chunk(&at, file.end(), "xfh0", &hierarchy);
+
+		ChunkView< MeshEntry > meshes;
+		view_chunk(&at, file.end(), "msh0", &meshes);
+
+		view_chunk(&at, file.end(), "cam0", &cameras);
+		view_chunk(&at, file.end(), "lmp0", &lights);
+
+		//--------------------------------
+		//Now that file is loaded, create transforms for hierarchy entries:
+
+		hierarchy_transforms.reserve(hierarchy.size());
+
+		for (auto const &h : hierarchy) {
+			transforms.emplace_back();
+			Transform *t = &transforms.back();
+			if (h.parent != -1U) {
+				if (h.parent >= hierarchy_transforms.size()) {
+					throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
+				}
+				t->set_parent(hierarchy_transforms[h.parent]);
+			}
+
+			if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
+				t->name = get_name(h.name_begin, h.name_end);
+				t->name_id = intern_name(t->name);
+			} else {
+					throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
+			}
+
+			t->position = h.position;
+			t->rotation = h.rotation;
+			t->scale = h.scale;
+
+			hierarchy_transforms.emplace_back(t);
 		}
+		assert(hierarchy_transforms.size() == hierarchy.size());
 
-		t->position = h.position;
-		t->rotation = h.rotation;
-		t->scale = h.scale;
+		for (auto const &m : meshes) {
+			if (m.transform >= hierarchy_transforms.size()) {
+				throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+			}
+			if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+				throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
+			}
+			add_drawable(hierarchy_transforms[m.transform], intern_name(get_name(m.name_begin, m.name_end)), nullptr, nullptr);
+		}
+	} else {
+		ChunkView< HeaderV1 > header;
+		view_chunk(&at, file.end(), "scn1", &header);
+		if (header.size() != 1 || header[0].version != 1) {
+			throw std::runtime_error("scene file '" + filename + "' has an unsupported header");
+		}
 
-		hierarchy_transforms.emplace_back(t);
-	}
-	assert(hierarchy_transforms.size() == hierarchy.size());
+		view_chunk(&at, file.end(), "str0", &names);
+
+		ChunkView< uint32_t > name_offsets;
+		view_chunk(&at, file.end(), "nmo1", &name_offsets);
+
+		ChunkView< uint32_t > name_table;
+		view_chunk(&at, file.end(), "nam1", &name_table);
+
+		ChunkView< HierarchyEntryV1 > hierarchy;
+		view_chunk(&at, file.end(), "xfh1", &hierarchy);
 
-	for (auto const &m : meshes) {
-		if (m.transform >= hierarchy_transforms.size()) {
-			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+		ChunkView< MeshEntryV1 > meshes;
+		view_chunk(&at, file.end(), "msh1", &meshes);
+
+		view_chunk(&at, file.end(), "cam0", &cameras);
+		view_chunk(&at, file.end(), "lmp0", &lights);
+
+		//--------------------------------
+		//names:
+
+		if (name_offsets.size() == 0) {
+			throw std::runtime_error("scene file '" + filename + "' contains an empty name offset chunk");
 		}
-		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
-			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
+		uint32_t name_count = uint32_t(name_offsets.size()) - 1;
+		for (uint32_t i = 0; i < name_count; ++i) {
+			if (!(name_offsets[i] <= name_offsets[i+1] && name_offsets[i+1] <= names.size())) {
+				throw std::runtime_error("scene file '" + filename + "' contains invalid name offsets");
+			}
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
 
-		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
+		//ids in the file -> ids in this scene:
+		std::vector< uint32_t > name_ids(name_count);
+
+		//the stored table can be used as-is if it looks sane and this scene doesn't have names yet:
+		bool table_ok = name_strings.empty()
+			&& name_table.size() > 0 && name_table.size() >= 2 * size_t(name_count)
+			&& (name_table.size() & (name_table.size() - 1)) == 0;
+		if (table_ok) {
+			std::vector< bool > seen(name_count, false);
+			uint32_t used = 0;
+			for (uint32_t id : name_table) {
+				if (id == -1U) continue;
+				if (id >= name_count || seen[id]) {
+					table_ok = false;
+					break;
+				}
+				seen[id] = true;
+				++used;
+			}
+			table_ok = table_ok && used == name_count;
+		}
+		if (table_ok) {
+			name_strings.reserve(name_count);
+			for (uint32_t i = 0; i < name_count; ++i) {
+				name_strings.emplace_back(names.data + name_offsets[i], names.data + name_offsets[i+1]);
+				name_ids[i] = i;
+			}
+			name_buckets.resize(name_table.size());
+			std::memcpy(name_buckets.data(), name_table.data, name_table.size() * sizeof(uint32_t));
+		} else {
+			for (uint32_t i = 0; i < name_count; ++i) {
+				name_ids[i] = intern_name(std::string(names.data + name_offsets[i], names.data + name_offsets[i+1]));
+			}
+		}
+
+		//--------------------------------
+		//transforms:
+
+		hierarchy_transforms.reserve(hierarchy.size());
+
+		for (auto const &h : hierarchy) {
+			transforms.emplace_back();
+			Transform *t = &transforms.back();
+			if (h.parent != -1U) {
+				if (h.parent >= hierarchy_transforms.size()) {
+					throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
+				}
+				t->set_parent(hierarchy_transforms[h.parent]);
+			}
+
+			if (h.name >= name_count) {
+				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name id");
+			}
+			t->name_id = name_ids[h.name];
+			t->name = name_strings[t->name_id];
+
+			t->position = h.position;
+			t->rotation = h.rotation;
+			t->scale = h.scale;
+
+			//world matrices are stored, so seed the cache (which set_cache_world(true) keeps, unless marked dirty first):
+			// (cache_world itself stays off, so matrices are computed as usual until the caller opts in)
+			t->cached_local_to_world = h.local_to_world;
+			t->local_to_world_dirty = false;
+
+			hierarchy_transforms.emplace_back(t);
 		}
+		assert(hierarchy_transforms.size() == hierarchy.size());
 
+		for (auto const &m : meshes) {
+			if (m.transform >= hierarchy_transforms.size()) {
+				throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+			}
+			if (m.name >= name_count) {
+				throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name id");
+			}
+			add_drawable(hierarchy_transforms[m.transform], name_ids[m.name], &m.min, &m.max);
+		}
 	}
 
 	for (auto const &c : cameras) {
@@ -302,9 +1274,18 @@ void Scene::load(std::string const &filename,
 	}
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	// (from a stream over the rest of the mapped file)
+	MemoryStreambuf rest(at, file.end());
+	std::istream extra(&rest);
+	load_extra(extra, std::vector< char >(names.data, names.data + names.size()), hierarchy_transforms);
+
+	//new transforms aren't in packed storage yet:
+	if (packed.active) packed.needs_repack = true;
+
+	//make new transforms findable by name:
+	index_names();
 
-	if (file.peek() != EOF) {
+	if (extra.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -312,12 +1293,229 @@ void Scene::load(std::string const &filename,
 
 }
 
+void Scene::save(std::string const &filename, uint32_t version) const {
+	if (version > 1) {
+		throw std::runtime_error("can't save scene file '" + filename + "' in unknown version " + std::to_string(version));
+	}
+
+	//transforms are written parents-first, as the loader expects:
+	std::unordered_map< Transform const *, uint32_t > transform_index;
+	for (auto const &t : transforms) {
+		transform_index.emplace(&t, -1U);
+	}
+	std::vector< Transform const * > order;
+	order.reserve(transforms.size());
+	for (auto const &t : transforms) {
+		//write any not-yet-written ancestors (root first), then t:
+		std::vector< Transform const * > chain;
+		for (Transform const *a = &t; a; a = a->parent) {
+			auto f = transform_index.find(a);
+			if (f == transform_index.end()) {
+				throw std::runtime_error("transform '" + t.name + "' has an ancestor that is not part of this scene.");
+			}
+			if (f->second != -1U) break;
+			chain.emplace_back(a);
+		}
+		for (auto a = chain.rbegin(); a != chain.rend(); ++a) {
+			transform_index[*a] = uint32_t(order.size());
+			order.emplace_back(*a);
+		}
+	}
+	auto get_index = [&transform_index](Transform const *t) {
+		auto f = transform_index.find(t);
+		if (f == transform_index.end()) {
+			throw std::runtime_error("scene object refers to a transform that is not part of this scene.");
+		}
+		return f->second;
+	};
+
+	//names -- a copy of this scene's table, plus the names of transforms that haven't been interned:
+	std::vector< std::string > strings = name_strings;
+	std::vector< uint32_t > buckets = name_buckets;
+	auto get_name_id = [&](Transform const *t) {
+		if (t->name_id < name_strings.size() && name_strings[t->name_id] == t->name) return t->name_id;
+		return intern_name_in(strings, buckets, t->name);
+	};
+	std::vector< uint32_t > transform_names;
+	transform_names.reserve(order.size());
+	for (Transform const *t : order) {
+		transform_names.emplace_back(get_name_id(t));
+	}
+
+	std::vector< char > str0;
+	std::vector< uint32_t > name_offsets;
+	for (auto const &str : strings) {
+		name_offsets.emplace_back(uint32_t(str0.size()));
+		str0.insert(str0.end(), str.begin(), str.end());
+	}
+	name_offsets.emplace_back(uint32_t(str0.size()));
+
+	//drawables are written as references to the meshes they were loaded from:
+	std::vector< Drawable const * > mesh_drawables;
+	uint32_t unnamed = 0;
+	for (auto const &d : drawables) {
+		if (d.mesh_name_id < name_strings.size()) mesh_drawables.emplace_back(&d);
+		else ++unnamed;
+	}
+	if (unnamed) {
+		std::cerr << "WARNING: not saving " << unnamed << " drawable(s) with no mesh name to '" << filename << "'." << std::endl;
+	}
+
+	std::vector< CameraEntry > cam0;
+	for (auto const &c : cameras) {
+		CameraEntry entry;
+		entry.transform = get_index(c.transform);
+		std::memcpy(entry.type, "pers", 4);
+		entry.data = c.fovy / 3.1415926f * 180.0f; //FOV is stored in degrees
+		entry.clip_near = c.near;
+		entry.clip_far = std::numeric_limits< float >::infinity(); //(cameras use infinite perspective matrices)
+		cam0.emplace_back(entry);
+	}
+
+	std::vector< LightEntry > lmp0;
+	for (auto const &l : lights) {
+		LightEntry entry;
+		entry.transform = get_index(l.transform);
+		entry.type = char(l.type);
+		//stored as color * energy:
+		entry.energy = std::max(l.energy.r, std::max(l.energy.g, l.energy.b));
+		if (entry.energy > 0.0f) {
+			entry.color = glm::u8vec3(glm::round(glm::clamp(l.energy / entry.energy, 0.0f, 1.0f) * 255.0f));
+		} else {
+			entry.color = glm::u8vec3(0xff);
+			entry.energy = 0.0f;
+		}
+		entry.distance = 0.0f; //(not used)
+		entry.fov = l.spot_fov / 3.1415926f * 180.0f; //FOV is stored in degrees
+		lmp0.emplace_back(entry);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+
+	if (version == 0) {
+		std::vector< HierarchyEntry > xfh0;
+		xfh0.reserve(order.size());
+		for (uint32_t i = 0; i < order.size(); ++i) {
+			Transform const *t = order[i];
+			HierarchyEntry entry;
+			entry.parent = (t->parent ? transform_index.at(t->parent) : -1U);
+			entry.name_begin = name_offsets[transform_names[i]];
+			entry.name_end = name_offsets[transform_names[i] + 1];
+			entry.position = t->position;
+			entry.rotation = t->rotation;
+			entry.scale = t->scale;
+			xfh0.emplace_back(entry);
+		}
+
+		std::vector< MeshEntry > msh0;
+		for (Drawable const *d : mesh_drawables) {
+			MeshEntry entry;
+			entry.transform = get_index(d->transform);
+			entry.name_begin = name_offsets[d->mesh_name_id];
+			entry.name_end = name_offsets[d->mesh_name_id + 1];
+			msh0.emplace_back(entry);
+		}
+
+		write_chunk("str0", str0, &file);
+		write_chunk("xfh0", xfh0, &file);
+		write_chunk("msh0", msh0, &file);
+	} else { //version == 1
+		std::vector< HeaderV1 > scn1(1);
+		scn1[0].version = 1;
+
+		std::vector< HierarchyEntryV1 > xfh1;
+		xfh1.reserve(order.size());
+		for (uint32_t i = 0; i < order.size(); ++i) {
+			Transform const *t = order[i];
+			HierarchyEntryV1 entry;
+			entry.parent = (t->parent ? transform_index.at(t->parent) : -1U);
+			entry.name = transform_names[i];
+			entry.position = t->position;
+			entry.rotation = t->rotation;
+			entry.scale = t->scale;
+			entry.local_to_world = t->make_local_to_world();
+			xfh1.emplace_back(entry);
+		}
+
+		std::vector< MeshEntryV1 > msh1;
+		for (Drawable const *d : mesh_drawables) {
+			MeshEntryV1 entry;
+			entry.transform = get_index(d->transform);
+			entry.name = d->mesh_name_id;
+			entry.min = d->min;
+			entry.max = d->max;
+			msh1.emplace_back(entry);
+		}
+
+		write_chunk("scn1", scn1, &file);
+		write_chunk("str0", str0, &file);
+		write_chunk("nmo1", name_offsets, &file);
+		write_chunk("nam1", buckets, &file);
+		write_chunk("xfh1", xfh1, &file);
+		write_chunk("msh1", msh1, &file);
+	}
+	write_chunk("cam0", cam0, &file);
+	write_chunk("lmp0", lmp0, &file);
+
+	if (!file) {
+		throw std::runtime_error("failed to write scene file '" + filename + "'.");
+	}
+}
+
 //-------------------------
 
 Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 	load(filename, on_drawable);
 }
 
+uint32_t Scene::intern_name(std::string const &name) {
+	return intern_name_in(name_strings, name_buckets, name);
+}
+
+uint32_t Scene::find_name(std::string const &name) const {
+	return find_name_in(name_strings, name_buckets, name);
+}
+
+void Scene::index_names() {
+	transforms_by_name.assign(name_strings.size(), nullptr);
+	for (auto &t : transforms) {
+		//(re-)intern if the name was never interned or has been changed since:
+		if (t.name_id >= name_strings.size() || name_strings[t.name_id] != t.name) {
+			t.name_id = intern_name(t.name);
+			if (transforms_by_name.size() < name_strings.size()) transforms_by_name.resize(name_strings.size(), nullptr);
+		}
+		if (transforms_by_name[t.name_id] == nullptr) transforms_by_name[t.name_id] = &t;
+	}
+}
+
+Scene::Transform *Scene::find_transform(uint32_t name_id) const {
+	if (name_id >= transforms_by_name.size()) return nullptr;
+	return transforms_by_name[name_id];
+}
+
+Scene::Transform *Scene::find_transform(std::string const &name) const {
+	return find_transform(find_name(name));
+}
+
+Scene::TransformHandle Scene::find_handle(std::string const &name) const {
+	Transform *transform = find_transform(name);
+	if (!transform || transform->packed != &packed) return TransformHandle();
+	return get_handle(transform);
+}
+
+void Scene::set_cache_world(bool cache_world) {
+	for (auto &t : transforms) {
+		if (t.cache_world == cache_world) continue; //(cache is already being maintained)
+		t.cache_world = cache_world;
+		//matrices cached before caching was turned off may be stale by the time it is turned back on:
+		// (so clean flags on a transform that isn't caching only ever mean "seeded by load()")
+		if (!cache_world) {
+			t.local_to_world_dirty = true;
+			t.world_to_local_dirty = true;
+		}
+	}
+}
+
 Scene::Scene(Scene const &other) {
 	set(other);
 }
@@ -327,51 +1525,139 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
+	//Transform pointers are remapped without hashing:
+	// a packed source already numbers its transforms, so other's transform i becomes copies[i];
+	// otherwise, other's transforms are found by binary search in a table sorted by address.
+	bool by_packed = other.packed.active && !other.packed.needs_repack && other.packed.size() == other.transforms.size();
+	if (by_packed) {
+		for (auto const &t : other.transforms) {
+			if (t.packed != &other.packed) {
+				by_packed = false;
+				break;
+			}
+		}
+	}
+	std::vector< Transform * > copies; //other's packed index -> new transform
+	std::vector< std::pair< Transform const *, Transform * > > sorted; //other's transform -> new transform, by address
 
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
+	auto remap = [&](Transform const *t) -> Transform * {
+		if (t == nullptr) return nullptr;
+		if (by_packed) {
+			if (t->packed == &other.packed) return copies[t->packed_index];
+		} else {
+			auto f = std::lower_bound(sorted.begin(), sorted.end(), std::make_pair(t, (Transform *)nullptr));
+			if (f != sorted.end() && f->first == t) return f->second;
+		}
+		throw std::runtime_error("copied scene refers to a transform '" + t->name + "' that is not part of it.");
+	};
 
-	//Copy transforms and store mapping:
+	//Copy transforms:
+	packed.clear();
 	transforms.clear();
+	if (by_packed) copies.assign(other.packed.size(), nullptr);
+	else sorted.reserve(other.transforms.size());
 	for (auto const &t : other.transforms) {
 		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+		Transform &copy = transforms.back();
+		copy.name = t.name;
+		copy.name_id = t.name_id;
+		copy.position = t.position;
+		copy.rotation = t.rotation;
+		copy.scale = t.scale;
+		copy.cache_world = t.cache_world;
+		//(same hierarchy, so cached world matrices carry over)
+		copy.local_to_world_dirty = t.local_to_world_dirty;
+		copy.world_to_local_dirty = t.world_to_local_dirty;
+		copy.cached_local_to_world = t.cached_local_to_world;
+		copy.cached_world_to_local = t.cached_world_to_local;
+		copy.handle = t.handle; //so handles remain valid in the copy
+
+		if (by_packed) {
+			copy.packed = &packed;
+			copy.packed_index = t.packed_index;
+			copies[t.packed_index] = &copy;
+		} else {
+			sorted.emplace_back(&t, &copy);
+		}
+	}
+	if (!by_packed) std::sort(sorted.begin(), sorted.end());
+
+	//update transform parents and child lists (keeping other's child order):
+	{
+		auto copy = transforms.begin();
+		for (auto const &t : other.transforms) {
+			copy->parent = remap(t.parent);
+			copy->children.reserve(t.children.size());
+			for (Transform const *child : t.children) {
+				copy->children.emplace_back(remap(child));
+			}
+			++copy;
+		}
+	}
 
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
+	if (transform_map) {
+		transform_map->clear();
+		transform_map->reserve(other.transforms.size() + 1);
+		transform_map->emplace(nullptr, nullptr);
+		auto copy = transforms.begin();
+		for (auto const &t : other.transforms) {
+			transform_map->emplace(&t, &*copy);
+			++copy;
+		}
 	}
 
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	//copy interned names and re-build the name index for the new transforms:
+	name_strings = other.name_strings;
+	name_buckets = other.name_buckets;
+	index_names();
+
+	//copy packed storage (the arrays are already in the right order for the copies) or, if other's is out of date, re-build it:
+	if (by_packed) {
+		packed.active = true;
+		packed.positions = other.packed.positions;
+		packed.rotations = other.packed.rotations;
+		packed.scales = other.packed.scales;
+		packed.parents = other.packed.parents;
+		packed.local_to_world = other.packed.local_to_world;
+		packed.world_to_local = other.packed.world_to_local;
+		packed.dirty = other.packed.dirty;
+		packed.transforms = copies;
+		packed.handle_index = other.packed.handle_index;
+		packed.level_begin = other.packed.level_begin;
+		packed.pending = other.packed.pending;
+	} else if (other.packed.active) {
+		pack_transforms();
 	}
 
 	//copy other's drawables, updating transform pointers:
+	// (the drawable BVH is not copied; call update_drawable_bvh() to build one)
 	drawables = other.drawables;
+	drawable_bvh = BVH();
+	bvh_drawables.clear();
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = remap(d.transform);
+	}
+	baked_drawables = other.baked_drawables;
+	for (auto &d : baked_drawables) {
+		d.transform = remap(d.transform);
 	}
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = remap(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = remap(l.transform);
+	}
+
+	//copy other's occluders, updating transform pointers:
+	occluders = other.occluders;
+	for (auto &o : occluders) {
+		o.transform = remap(o.transform);
 	}
 }
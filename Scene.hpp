@@ -11,10 +11,16 @@
  */
 
 #include "GL.hpp"
+#include "BVH.hpp"
+#include "light_clusters.hpp"
+#include "occlusion_buffer.hpp"
+#include "render_commands.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <array>
+#include <limits>
 #include <list>
 #include <memory>
 #include <functional>
@@ -22,10 +28,17 @@
 #include <vector>
 #include <unordered_map>
 
+struct MeshCluster;
+
+struct ThreadPool;
+
 struct Scene {
+	struct TransformArrays;
+
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
 		std::string name;
+		uint32_t name_id = -1U; //interned name (see Scene::intern_name()); -1U if not interned
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -43,17 +56,114 @@ struct Scene {
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
+		//Cached world matrices (opt-in):
+		// when 'cache_world' is set, make_local_to_world() and make_world_to_local() keep their
+		// result around and only recompute it after this transform (or an ancestor) is marked dirty.
+		// In this mode, use the set_* functions below (or call mark_dirty() after writing
+		// position/rotation/scale directly), and always re-parent via set_parent():
+		bool cache_world = false;
+		void set_position(glm::vec3 const &position_);
+		void set_rotation(glm::quat const &rotation_);
+		void set_scale(glm::vec3 const &scale_);
+		void set_parent(Transform *parent_);
+		void mark_dirty(); //flags this transform and all of its descendants for recomputation
+
+		//child list, maintained by set_parent() and used to propagate dirty flags:
+		std::vector< Transform * > children;
+
+		//cache storage (n.b. a dirty transform with 'cache_world' set always has dirty descendants):
+		mutable bool local_to_world_dirty = true;
+		mutable bool world_to_local_dirty = true;
+		mutable glm::mat4x3 cached_local_to_world = glm::mat4x3(1.0f);
+		mutable glm::mat4x3 cached_world_to_local = glm::mat4x3(1.0f);
+
+		//Packed storage (see Scene::pack_transforms()):
+		// when 'packed' is set, mark_dirty() also writes position/rotation/scale through to
+		// the packed arrays, and world matrices are read from them when they are up to date:
+		TransformArrays *packed = nullptr;
+		uint32_t packed_index = -1U; //current index in the packed arrays
+		uint32_t handle = -1U; //stable handle (assigned on first pack; see TransformHandle)
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
 	};
 
+	//Handles refer to transforms in packed storage, and stay valid when the storage is re-packed:
+	struct TransformHandle {
+		uint32_t index = -1U;
+		bool operator==(TransformHandle const &o) const { return index == o.index; }
+		bool operator!=(TransformHandle const &o) const { return index != o.index; }
+	};
+
+	//Packed transform storage keeps transform data in parallel arrays, sorted so that parents
+	// always come before their children, so world matrices can be computed in one linear pass:
+	struct TransformArrays {
+		bool active = false; //set by pack_transforms()
+
+		std::vector< glm::vec3 > positions;
+		std::vector< glm::quat > rotations;
+		std::vector< glm::vec3 > scales;
+		std::vector< uint32_t > parents; //index of parent, or -1U for roots; always less than own index
+		std::vector< glm::mat4x3 > local_to_world;
+		std::vector< glm::mat4x3 > world_to_local;
+		std::vector< uint8_t > dirty; //local data changed since the last update_transforms()
+		std::vector< Transform * > transforms; //back-references, for pointer-based access
+
+		std::vector< uint32_t > handle_index; //TransformHandle::index -> current index (or -1U)
+
+		//transforms at depth d in the hierarchy are [level_begin[d], level_begin[d+1]):
+		std::vector< uint32_t > level_begin;
+
+		bool pending = false; //some transform was marked dirty since the last update_transforms()
+		bool needs_repack = false; //hierarchy changed in a way that breaks the current order
+
+		uint32_t size() const { return uint32_t(positions.size()); }
+		void clear();
+	};
+
 	struct Drawable {
 		//a 'Drawable' attaches attribute data to a transform:
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//Bounding box in local (transform) space, used for view-frustum culling:
+		// (usually copied from Mesh::min/max; the default "empty" box means "never cull")
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		//interned name (see Scene::intern_name()) of the mesh this drawable shows, if known:
+		// (set by Scene::load() for drawables made in its callback; drawables without one aren't saved by Scene::save())
+		uint32_t mesh_name_id = -1U;
+
+		//Drawables that never move may be merged into world-space batches (see bake_static_drawables()):
+		bool static_geometry = false;
+
+		//(optional) lower levels of detail, finest first; pipeline.start/count is the full-detail mesh:
+		// draw() uses lods[i] while the drawable's projected size is below lods[i].screen_size
+		// (see Scene::lod_hysteresis; MeshBuffer::lookup_lods() finds these meshes by name)
+		struct LOD {
+			GLuint start = 0; //first vertex (or index, if the pipeline is indexed) to draw
+			GLuint count = 0; //number of vertices (or indices) to draw
+			GLuint base_vertex = 0; //(if the pipeline is indexed) added to each index
+			glm::vec3 position_scale = glm::vec3(1.0f); //(see Pipeline::position_scale)
+			glm::vec3 position_offset = glm::vec3(0.0f);
+			float screen_size = 0.0f; //bounding radius over view depth, times the projection's y scale (i.e., as a fraction of half the viewport height)
+		};
+		std::vector< LOD > lods;
+		//level draw() used last (0 is the full-detail mesh), kept for hysteresis:
+		// (this is one value shared by every view, so when several cameras draw the scene, hysteresis follows whichever recorded the drawable last)
+		mutable uint32_t lod = 0;
+
+		//(optional) clusters of the full-detail mesh's triangles, in index order (see MeshCluster; usually from Mesh::cluster_start/count):
+		// when an indexed drawable with clusters is drawn at full detail, draw() culls each cluster against the view
+		// (and occluders) and draws only the index ranges of visible ones, merged where they are adjacent
+		// (points into a MeshBuffer, which must outlive any drawing, like the pipeline's vertex arrays)
+		MeshCluster const *clusters = nullptr;
+		uint32_t cluster_count = 0;
+		// (n.b. clusters aren't culled by their normal cones, since draw() doesn't cull back faces -- so a back-facing cluster may still be seen)
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -65,13 +175,35 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			//indexed drawing (see Mesh::index_type):
+			// if 'index_type' is set, draw() uses glDrawElementsBaseVertex with the vao's element array buffer instead,
+			// and 'start' and 'count' are a range of indices of that type:
+			GLenum index_type = 0;
+			GLuint base_vertex = 0; //added to each index
+
+			//compact vertex positions (see Mesh::position_scale): draw() folds these into the object-to-clip and object-to-light matrices:
+			// (drawable.min/max and occluders stay in object space)
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
+
 			//uniforms:
+			// if the program declares the "Object" uniform block (see Scene::ObjectUniforms), set this and
+			// draw() will bind this object's slice of the block instead of setting the three matrix uniforms below:
+			bool object_uniform_block = false;
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
+			//(optional) instanced version of this pipeline:
+			// when set, drawables that match in everything above (and have no set_uniforms) are drawn
+			// together with one glDrawArraysInstanced call, with per-instance matrices in Scene::InstanceData.
+			struct Instanced {
+				GLuint program = 0; //program that reads matrices from per-instance attributes
+				GLuint vao = 0; //like 'vao', plus per-instance attributes from Scene::instance_buffer()
+			} instanced;
+
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
 			struct TextureInfo {
@@ -116,25 +248,242 @@ struct Scene {
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
 	};
 
+	struct Occluder {
+		//an 'Occluder' attaches occlusion-culling geometry to a transform:
+		Occluder(Transform *transform_) : transform(transform_) { assert(transform); }
+		Transform * transform;
+
+		//triangles (three positions each, in transform-local space) that hide whatever is behind them:
+		// (should be solid and simple -- walls, floors, large furniture; shared so copies of the scene don't duplicate it)
+		std::shared_ptr< std::vector< glm::vec3 > const > triangles;
+	};
+
 	//Scenes, of course, may have many of the above objects:
 	std::list< Transform > transforms;
 	std::list< Drawable > drawables;
+	std::list< Drawable > baked_drawables; //merged into static batches, so not drawn; kept for picking and such
 	std::list< Camera > cameras;
 	std::list< Light > lights;
+	std::list< Occluder > occluders;
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
-	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	// (drawables whose bounds are entirely outside the view frustum are skipped; the rest are
+	//  sorted by program, vertex array, and textures, then front-to-back, to reduce state changes)
+	// 'clusters', if given, must have been built for this view and uploaded (see light_clusters.hpp)
+	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f), LightClusters const *clusters = nullptr) const;
+
+	//..or record the same work as commands to execute later, e.g., on another thread (see render_commands.hpp):
+	// (no OpenGL calls; draw() is record() into 'draw_commands' followed by execute())
+	// transforms, lights, and 'frame_uniforms' are read during record(), so may change as soon as it returns;
+	// drawables' pipelines are used by the commands, so must not change until they run.
+	// commands->viewport should be set to the viewport the commands will run with.
+	void record(Camera const &camera, RenderCommands *commands) const;
+	void record(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, LightClusters const *clusters, RenderCommands *commands) const;
+	mutable RenderCommands draw_commands; //(re-used by draw() so that it doesn't allocate every frame)
+
+	//Clustered lighting:
+	// draw(Camera) bins the point and spot lights in 'lights' into 'light_clusters' for the camera's view,
+	// so that programs which read the cluster buffers (see LitColorTextureProgram) shade each fragment
+	// with only the lights near it. (The "Frame" block's light_* parameters are still used for one global light.)
+	// lights are treated as reaching out to where their intensity falls below 'light_threshold':
+	float light_threshold = 1.0f / 256.0f;
+	mutable LightClusters light_clusters;
+
+	//Level of detail:
+	// drawables with 'lods' only move to a coarser level once their projected size is this fraction
+	// below its threshold, and back once it is this fraction above, so they don't flicker between levels:
+	float lod_hysteresis = 0.1f;
+
+	//Occlusion culling:
+	// when there are 'occluders', draw() rasterizes them into 'occlusion_buffer' (on the CPU) and
+	// skips drawables whose bounds are entirely behind them:
+	bool occlusion_culling = true;
+	mutable OcclusionBuffer occlusion_buffer;
+
+	//Uniform blocks shared by all programs that declare them (std140 layout; see LitColorTextureProgram for the GLSL side):
+	// programs should bind their "Frame" and "Object" blocks to these binding points with glUniformBlockBinding:
+	enum : GLuint {
+		FrameUniformBinding = 0,
+		ObjectUniformBinding = 1,
+	};
+
+	//"Frame" block, uploaded once per draw() call:
+	struct FrameUniforms {
+		glm::mat4 world_to_clip; //(set by draw())
+		glm::mat4 world_to_light; //mat4x3 in std140 is four padded columns; (set by draw())
+		glm::vec3 light_location = glm::vec3(0.0f);
+		int32_t light_type = 0; //0: point, 1: hemisphere, 2: spot, 3: directional
+		glm::vec3 light_direction = glm::vec3(0.0f, 0.0f,-1.0f);
+		float light_cutoff = 1.0f; //cosine of spot angle
+		glm::vec3 light_energy = glm::vec3(1.0f);
+		float padding_ = 0.0f;
+		//clustered lights (set by draw(); see LightClusters):
+		glm::uvec4 cluster_counts = glm::uvec4(0); //tiles x, tiles y, slices (all zero if no clusters), unused
+		glm::vec4 cluster_tile = glm::vec4(0.0f); //tile = (gl_FragCoord.xy - zw) * xy
+		glm::vec4 cluster_depth = glm::vec4(0.0f); //slice = log(view depth) * x + y
+	};
+	static_assert(sizeof(FrameUniforms) == 224, "FrameUniforms matches std140 layout.");
+
+	//light parameters for the "Frame" block (the camera parts are filled in by draw()):
+	FrameUniforms frame_uniforms;
+
+	//"Object" block, one per drawable; all of a draw() call's blocks are written in one pass
+	// into a single mapped ring buffer, and each draw just binds its slice:
+	struct ObjectUniforms {
+		glm::mat4 object_to_clip;
+		glm::mat4 object_to_light; //mat4x3 in std140 is four padded columns
+		glm::mat3x4 normal_to_light; //mat3 in std140 is three padded columns
+	};
+	static_assert(sizeof(ObjectUniforms) == 176, "ObjectUniforms matches std140 layout.");
+
+	//per-instance data for instanced pipelines (see Pipeline::instanced):
+	// instanced programs read these as attributes INSTANCE_OBJECT_TO_CLIP, INSTANCE_OBJECT_TO_LIGHT, and INSTANCE_NORMAL_TO_LIGHT
+	struct InstanceData {
+		glm::mat4 object_to_clip;
+		glm::mat4x3 object_to_light;
+		glm::mat3 normal_to_light;
+	};
+	static_assert(sizeof(InstanceData) == 4*16 + 4*12 + 3*12, "InstanceData is packed.");
+
+	//buffer that draw() streams InstanceData through (shared by all scenes; created on first call):
+	// instanced vertex array objects should read from this (see MeshBuffer::make_instanced_vao_for_program)
+	static GLuint instance_buffer();
+
+	//counts from the most recent draw() call:
+	struct DrawStats {
+		uint32_t drawn = 0; //drawables sent to OpenGL
+		uint32_t culled = 0; //drawables skipped because their bounds were outside the view frustum
+		uint32_t occluded = 0; //drawables skipped because their bounds were behind occluders
+		uint32_t draw_calls = 0; //glDrawArrays* calls made
+		uint32_t vertices = 0; //vertices (or, for indexed pipelines, indices) submitted (summed over instances)
+		uint32_t lod_drawn = 0; //drawables drawn at a level of detail other than their full-detail mesh
+		uint32_t instanced = 0; //drawables drawn as part of an instanced draw call
+		uint32_t clusters_culled = 0; //clusters of drawn drawables skipped (outside the view, or occluded)
+	};
+	mutable DrawStats draw_stats;
+
+	//record()'s working storage, cleared (but not freed) each call so that recording similar frames doesn't allocate:
+	// (like draw_stats, this means one scene shouldn't be recorded on two threads at once)
+	struct DrawPacket {
+		Drawable const *drawable;
+		glm::mat4x3 object_to_world;
+		glm::mat4 object_to_clip;
+		GLuint start, count; //vertex (or index) range of the level of detail being drawn
+		GLuint base_vertex; //(for indexed pipelines)
+		glm::vec3 position_scale, position_offset; //(for compact vertex buffers)
+		uint32_t ranges_begin, ranges_end; //index ranges of visible clusters (if not empty, drawn instead of start/count)
+	};
+	struct DrawSortEntry {
+		uint64_t key;
+		uint32_t packet;
+	};
+	typedef std::array< GLuint, Drawable::Pipeline::TextureCount > TextureSet;
+	typedef std::array< GLuint, 7 > MeshKey; //type, index type, start, count, base vertex, instanced program, instanced vao
+	struct RecordScratch {
+		std::vector< LightClusters::Light > cluster_lights;
+		std::vector< uint8_t > bvh_visible;
+		std::vector< DrawPacket > packets;
+		std::vector< glm::uvec2 > ranges; //(first index, count) of visible clusters, for packets that only draw some
+		std::vector< DrawSortEntry > entries;
+		std::vector< DrawSortEntry > sort_temp;
+		//distinct programs, vertex arrays, texture sets, and meshes in this frame's packets, sorted (so a value's rank is its index):
+		std::vector< GLuint > programs;
+		std::vector< GLuint > vaos;
+		std::vector< TextureSet > texture_sets;
+		std::vector< MeshKey > meshes;
+		std::vector< InstanceData > instances;
+	};
+	mutable RecordScratch record_scratch;
+
+	//helper: is the box [min,max] (possibly) inside the frustum of the given clip matrix?
+	// (conservative -- may return true for some boxes that are actually outside)
+	static bool box_in_frustum(glm::mat4 const &to_clip, glm::vec3 const &min, glm::vec3 const &max);
+
+	//BVH over the world-space bounds of drawables (only maintained by update_drawable_bvh()):
+	// item i of the BVH is bvh_drawables[i]; when these are in sync with 'drawables', draw()
+	// uses the BVH to skip whole groups of out-of-view drawables at once.
+	BVH drawable_bvh;
+	std::vector< Drawable * > bvh_drawables;
+
+	//refit 'drawable_bvh' to current drawable positions, or rebuild it if drawables were
+	// added/removed or refitting has degraded the tree:
+	// (call after moving things -- and after update_transforms(), if packed -- and before draw())
+	void update_drawable_bvh();
+
+	//helpers for gameplay code (use the BVH as of the last update_drawable_bvh()):
+	// call 'fn' for every drawable whose world-space bounds overlap [min,max]:
+	void find_drawables(glm::vec3 const &min, glm::vec3 const &max, std::function< void(Drawable &) > const &fn) const;
+	// nearest drawable whose world-space bounds are hit by origin + t * direction, t in [0,max_t]:
+	// (returns nullptr if nothing was hit; otherwise sets *t_ to the hit distance if t_ is non-null)
+	Drawable *raycast_drawables(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *t_ = nullptr) const;
+
+	//packed copy of the transform hierarchy (only maintained after pack_transforms()):
+	TransformArrays packed;
+
+	//(re-)build 'packed' from 'transforms'; once packed, the scene stays packed:
+	// throws if a transform's parent is not in this scene
+	void pack_transforms();
+
+	//recompute packed world matrices for transforms that were marked dirty (and their descendants):
+	// (does nothing if the scene is not packed; re-packs if the hierarchy changed shape)
+	void update_transforms();
+
+	//if set, update_transforms() splits each hierarchy level into chunks and runs them on this pool;
+	// if null (the default), it runs on the calling thread:
+	ThreadPool *update_pool = nullptr;
+
+	//convert between handles and transforms in packed storage:
+	TransformHandle get_handle(Transform const *transform) const;
+	Transform *get_transform(TransformHandle handle) const;
+
+	//Interned names:
+	// each distinct transform (or mesh) name is stored once in 'name_strings' and referred to by its index (Transform::name_id);
+	// the name index maps name ids to transforms, so lookups by name cost one hash instead of a scan over transforms.
+	std::vector< std::string > name_strings; //name id -> name
+	std::vector< uint32_t > name_buckets; //name -> name id hash table (open addressing; -1U for empty; stored in v1 scene files)
+	std::vector< Transform * > transforms_by_name; //name id -> first transform with that name (or nullptr)
+
+	//get the id for a name, adding it to the table if needed:
+	uint32_t intern_name(std::string const &name);
+	//get the id for a name, or -1U if no transform was ever given that name:
+	uint32_t find_name(std::string const &name) const;
+
+	//(re-)build the name index from 'transforms' (interning any names that aren't yet):
+	// load() and set() do this; call it yourself after adding, renaming, or removing transforms
+	void index_names();
+
+	//look up transforms by name (returns nullptr / an invalid handle if there is no such transform):
+	// if several transforms share a name, the first one in 'transforms' is returned
+	Transform *find_transform(uint32_t name_id) const;
+	Transform *find_transform(std::string const &name) const;
+	// (handles are only valid for packed scenes; see pack_transforms())
+	TransformHandle find_handle(std::string const &name) const;
+
+	//turn cached world matrices (see Transform::cache_world) on or off for every transform:
+	// (turning them on keeps world matrices load() read from a v1 file for transforms that haven't been
+	//  marked dirty since -- so if you wrote position/rotation/scale directly after loading, call mark_dirty() first)
+	void set_cache_world(bool cache_world);
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
+	// (v1 files -- see save() -- also set the bounds of drawables made by the callback, and seed the
+	//  transforms' caches with their stored world matrices; cache_world is left off either way, see set_cache_world())
 	void load(std::string const &filename,
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
 
+	//write transforms/drawables/cameras/lights to a scene file:
+	// version 0 is the format written by the blender exporter;
+	// version 1 adds precomputed data: world matrices, drawable bounds, and the name table (so names are
+	//  referred to by id and loading doesn't need to hash them)
+	// drawables are written as (transform, mesh name) pairs, so only drawables with a mesh_name_id are saved.
+	// throws if the file can't be written
+	void save(std::string const &filename, uint32_t version = 0) const;
+
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
 	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
@@ -149,5 +498,7 @@ struct Scene {
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
+	// (copying a packed scene copies its arrays wholesale and remaps pointers by packed index;
+	//  the mapping is only built when asked for)
 	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
 };
@@ -1,5 +1,6 @@
 #include "ShowSceneMode.hpp"
 #include "DrawLines.hpp"
+#include "gl_state.hpp"
 
 #include <iostream>
 
@@ -136,4 +137,25 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 		*/
 	}
 
+	{ //report culling results from scene.draw() in the corner:
+		glDisable(GL_DEPTH_TEST);
+		float aspect = float(drawable_size.x) / float(drawable_size.y);
+		DrawLines overlay(glm::mat4(
+			1.0f / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		));
+		constexpr float H = 0.06f;
+		overlay.draw_text("drawn: " + std::to_string(scene.draw_stats.drawn) + " culled: " + std::to_string(scene.draw_stats.culled) + " draw calls: " + std::to_string(scene.draw_stats.draw_calls),
+			glm::vec3(-aspect + 0.5f * H, 1.0f - 1.5f * H, 0.0f),
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			glm::u8vec4(0xff, 0xff, 0xff, 0xff));
+		//(GL call counts are from the last complete frame, since this one isn't done yet)
+		overlay.draw_text("gl calls: " + std::to_string(gl_state.last_frame.issued) + " skipped: " + std::to_string(gl_state.last_frame.skipped),
+			glm::vec3(-aspect + 0.5f * H, 1.0f - 3.0f * H, 0.0f),
+			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+			glm::u8vec4(0xff, 0xff, 0xff, 0xff));
+	}
+
 }
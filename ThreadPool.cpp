@@ -0,0 +1,84 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+ThreadPool::ThreadPool(uint32_t threads) {
+	if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency());
+	workers.reserve(threads - 1);
+	for (uint32_t i = 1; i < threads; ++i) {
+		workers.emplace_back(&ThreadPool::worker_main, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::parallel_for(uint32_t begin, uint32_t end, uint32_t grain, std::function< void(uint32_t, uint32_t) > const &fn) {
+	if (end <= begin) return;
+	grain = std::max(1U, grain);
+
+	//not worth waking anyone for a single chunk:
+	if (workers.empty() || end - begin <= grain) {
+		fn(begin, end);
+		return;
+	}
+
+	{ //post job:
+		std::unique_lock< std::mutex > lock(mutex);
+		assert(busy == 0 && "parallel_for is not re-entrant");
+		job = &fn;
+		job_end = end;
+		job_grain = grain;
+		job_next.store(begin);
+		busy = uint32_t(workers.size());
+		generation += 1;
+	}
+	wake.notify_all();
+
+	run_chunks();
+
+	{ //wait for workers to finish their last chunks:
+		std::unique_lock< std::mutex > lock(mutex);
+		done.wait(lock, [this](){ return busy == 0; });
+		job = nullptr;
+	}
+}
+
+void ThreadPool::run_chunks() {
+	while (true) {
+		uint32_t begin = job_next.fetch_add(job_grain);
+		if (begin >= job_end) break;
+		uint32_t end = std::min(job_end, begin + job_grain);
+		(*job)(begin, end);
+	}
+}
+
+void ThreadPool::worker_main() {
+	uint64_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			wake.wait(lock, [this,&seen](){ return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+		}
+
+		run_chunks();
+
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			assert(busy > 0);
+			busy -= 1;
+			if (busy == 0) done.notify_one();
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * A ThreadPool keeps a few worker threads around so that data-parallel loops
+ * (e.g., Scene::update_transforms() on large hierarchies) can be spread across cores
+ * without paying thread start-up costs every frame.
+ *
+ * Usage:
+ *   ThreadPool pool(4); //calling thread + 3 workers
+ *   pool.parallel_for(0, count, 256, [&](uint32_t begin, uint32_t end) {
+ *       for (uint32_t i = begin; i < end; ++i) { ... }
+ *   });
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPool {
+	//'threads' counts the calling thread, so ThreadPool(1) runs everything inline:
+	// (zero means "one per hardware thread")
+	explicit ThreadPool(uint32_t threads = 0);
+	~ThreadPool();
+
+	//call fn(chunk_begin, chunk_end) for chunks of at most 'grain' items covering [begin,end):
+	// returns once every chunk is done. The calling thread works on chunks too.
+	// n.b. fn must not throw, and parallel_for must not be called from several threads at once.
+	void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, std::function< void(uint32_t, uint32_t) > const &fn);
+
+	//number of threads that run chunks (including the calling thread):
+	uint32_t size() const { return uint32_t(workers.size()) + 1; }
+
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	//-- internals --
+	std::vector< std::thread > workers;
+
+	std::mutex mutex;
+	std::condition_variable wake; //signalled when a new job is posted (or on quit)
+	std::condition_variable done; //signalled when the last worker finishes a job
+	uint64_t generation = 0; //incremented for every job
+	uint32_t busy = 0; //workers that haven't finished the current job
+	bool quit = false;
+
+	//current job (written under the mutex before 'generation' changes):
+	std::function< void(uint32_t, uint32_t) > const *job = nullptr;
+	uint32_t job_end = 0;
+	uint32_t job_grain = 1;
+	std::atomic< uint32_t > job_next{0};
+
+	void run_chunks();
+	void worker_main();
+};
@@ -0,0 +1,200 @@
+#include "bake_static_drawables.hpp"
+
+#include "read_write_chunk.hpp"
+#include "mesh_optimizer.hpp"
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+//FNV-1a, used to tell if a cache file was made from the same inputs:
+static void hash_bytes(uint64_t *hash, void const *data, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		*hash = (*hash ^ reinterpret_cast< uint8_t const * >(data)[i]) * 0x100000001b3ULL;
+	}
+}
+
+//version of what bake_static_drawables() does to merged vertices, hashed into the cache key:
+// (bump this whenever baking changes, so caches written by older code are re-baked rather than silently used)
+//  1: merged, welded vertices
+//  2: + optimize_meshes() and build_clusters()
+static uint32_t const CacheVersion = 2;
+
+std::unique_ptr< MeshBuffer > bake_static_drawables(Scene &scene, MeshBuffer const &meshes, std::string const &cache_filename) {
+	//group static drawables by everything in their pipelines that affects drawing:
+	struct Group {
+		std::vector< std::list< Scene::Drawable >::iterator > drawables;
+	};
+	std::vector< Group > groups;
+	std::map< std::vector< GLuint >, uint32_t > group_index;
+
+	for (auto d = scene.drawables.begin(); d != scene.drawables.end(); ++d) {
+		if (!d->static_geometry) continue;
+		Scene::Drawable::Pipeline const &pipeline = d->pipeline;
+		if (pipeline.program == 0 || pipeline.vao == 0 || pipeline.count == 0) continue;
+		if (pipeline.type != GL_TRIANGLES || pipeline.set_uniforms) continue;
+		if (!d->lods.empty()) continue; //(a batch would draw it at full detail from everywhere)
+		size_t elements = (pipeline.index_type != 0 ? meshes.indices.size() : meshes.vertices.size());
+		if (!(pipeline.start <= elements && pipeline.count <= elements - pipeline.start)) {
+			throw std::runtime_error("static drawable '" + d->transform->name + "' has vertices outside of the mesh buffer");
+		}
+		for (uint32_t e = pipeline.start; e < pipeline.start + pipeline.count; ++e) {
+			if (meshes.element_vertex(pipeline.index_type, pipeline.base_vertex, e) >= meshes.vertices.size()) {
+				throw std::runtime_error("static drawable '" + d->transform->name + "' has vertices outside of the mesh buffer");
+			}
+		}
+
+		std::vector< GLuint > key{
+			pipeline.program,
+			GLuint(pipeline.object_uniform_block),
+			pipeline.OBJECT_TO_CLIP_mat4, pipeline.OBJECT_TO_LIGHT_mat4x3, pipeline.NORMAL_TO_LIGHT_mat3,
+		};
+		for (auto const &texture : pipeline.textures) {
+			key.emplace_back(texture.texture);
+			key.emplace_back(texture.texture ? texture.target : 0);
+		}
+		auto ret = group_index.emplace(key, uint32_t(groups.size()));
+		if (ret.second) groups.emplace_back();
+		groups[ret.first->second].drawables.emplace_back(d);
+	}
+
+	if (groups.empty()) return nullptr;
+
+	auto batch_name = [](uint32_t g) {
+		return "batch" + std::to_string(g);
+	};
+
+	//world-space vertices of a drawable's triangles (indexed meshes are expanded; the merged buffer is welded again):
+	auto transform_vertices = [&meshes](Scene::Drawable const &drawable, std::vector< MeshBuffer::Vertex > *to) {
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		glm::mat4x3 to_world = drawable.transform->make_local_to_world();
+		glm::mat3 normal_to_world = glm::inverse(glm::transpose(glm::mat3(to_world)));
+		for (uint32_t e = pipeline.start; e < pipeline.start + pipeline.count; ++e) {
+			MeshBuffer::Vertex vertex = meshes.vertices[meshes.element_vertex(pipeline.index_type, pipeline.base_vertex, e)];
+			vertex.Position = to_world * glm::vec4(vertex.Position, 1.0f);
+			glm::vec3 normal = normal_to_world * vertex.Normal;
+			float length = glm::length(normal);
+			if (length > 0.0f) vertex.Normal = normal / length;
+			to->emplace_back(vertex);
+		}
+	};
+
+	//key for the cache file covers the baking code's version, grouping, transforms, and source vertices:
+	uint64_t key = 0xcbf29ce484222325ULL;
+	hash_bytes(&key, &CacheVersion, sizeof(CacheVersion));
+	for (auto const &group : groups) {
+		uint32_t count = uint32_t(group.drawables.size());
+		hash_bytes(&key, &count, sizeof(count));
+		for (auto const &d : group.drawables) {
+			glm::mat4x3 to_world = d->transform->make_local_to_world();
+			hash_bytes(&key, &to_world, sizeof(to_world));
+			for (uint32_t e = d->pipeline.start; e < d->pipeline.start + d->pipeline.count; ++e) {
+				hash_bytes(&key, &meshes.vertices[meshes.element_vertex(d->pipeline.index_type, d->pipeline.base_vertex, e)], sizeof(MeshBuffer::Vertex));
+			}
+		}
+	}
+
+	std::unique_ptr< MeshBuffer > merged;
+
+	//try the cache:
+	if (!cache_filename.empty()) {
+		if (std::ifstream(cache_filename, std::ios::binary)) {
+			try {
+				//(mapped and parsed in place, as MeshBuffer does for .pnct files, so the batches are only copied once)
+				std::unique_ptr< MappedFile > file(new MappedFile(cache_filename));
+				char const *at = file->begin();
+				ChunkView< uint64_t > file_key;
+				view_chunk(&at, file->end(), "key0", &file_key);
+				if (file_key.size() == 1 && file_key[0] == key) {
+					merged.reset(new MeshBuffer(std::move(file), at, cache_filename));
+					//double-check that the contents match what would be baked:
+					for (uint32_t g = 0; g < groups.size() && merged; ++g) {
+						uint32_t count = 0;
+						for (auto const &d : groups[g].drawables) count += d->pipeline.count;
+						auto f = merged->meshes.find(batch_name(g));
+						if (f == merged->meshes.end() || f->second.count != count) merged.reset();
+					}
+					if (!merged) std::cerr << "WARNING: static bake cache '" << cache_filename << "' doesn't match its key; re-baking." << std::endl;
+				}
+			} catch (std::exception const &e) {
+				std::cerr << "WARNING: failed to read static bake cache '" << cache_filename << "' (" << e.what() << "); re-baking." << std::endl;
+				merged.reset();
+			}
+		}
+	}
+
+	//bake (and write the cache):
+	if (!merged) {
+		std::vector< MeshBuffer::Vertex > vertices;
+		std::map< std::string, Mesh > batches;
+		for (uint32_t g = 0; g < groups.size(); ++g) {
+			Mesh batch;
+			batch.type = GL_TRIANGLES;
+			batch.start = GLuint(vertices.size());
+			for (auto const &d : groups[g].drawables) {
+				transform_vertices(*d, &vertices);
+			}
+			batch.count = GLuint(vertices.size()) - batch.start;
+			batches.emplace(batch_name(g), batch);
+		}
+		merged.reset(new MeshBuffer(vertices, batches, false));
+		//(batches are big, so are worth culling in parts; the clusters are saved in the cache too)
+		optimize_meshes(merged.get());
+		build_clusters(merged.get());
+		merged->upload();
+
+		if (!cache_filename.empty()) {
+			std::ofstream file(cache_filename, std::ios::binary);
+			write_chunk("key0", std::vector< uint64_t >(1, key), &file);
+			merged->save(file);
+			if (!file) {
+				std::cerr << "WARNING: failed to write static bake cache '" << cache_filename << "'." << std::endl;
+			}
+		}
+	}
+
+	//replace grouped drawables with one drawable per batch:
+	scene.transforms.emplace_back();
+	Scene::Transform *identity = &scene.transforms.back();
+	identity->name = "static batch";
+	identity->name_id = scene.intern_name(identity->name);
+	scene.index_names(); //(so find_transform() knows about it)
+	if (scene.packed.active) scene.packed.needs_repack = true; //(new transform isn't packed yet)
+
+	std::map< GLuint, GLuint > vao_for_program;
+	for (uint32_t g = 0; g < groups.size(); ++g) {
+		Mesh const &batch = merged->lookup(batch_name(g));
+		Scene::Drawable::Pipeline pipeline = groups[g].drawables[0]->pipeline;
+
+		auto f = vao_for_program.find(pipeline.program);
+		if (f == vao_for_program.end()) {
+			f = vao_for_program.emplace(pipeline.program, merged->make_vao_for_program(pipeline.program)).first;
+		}
+		pipeline.vao = f->second;
+		pipeline.start = batch.start;
+		pipeline.count = batch.count;
+		pipeline.index_type = batch.index_type;
+		pipeline.base_vertex = batch.vertex_start;
+		pipeline.position_scale = batch.position_scale;
+		pipeline.position_offset = batch.position_offset;
+		pipeline.instanced = Scene::Drawable::Pipeline::Instanced(); //(each batch is unique)
+
+		for (auto const &d : groups[g].drawables) {
+			scene.baked_drawables.splice(scene.baked_drawables.end(), scene.drawables, d);
+		}
+
+		scene.drawables.emplace_back(identity);
+		Scene::Drawable &drawable = scene.drawables.back();
+		drawable.pipeline = pipeline;
+		drawable.min = batch.min;
+		drawable.max = batch.max;
+		drawable.clusters = merged->clusters.data() + batch.cluster_start;
+		drawable.cluster_count = batch.cluster_count;
+		drawable.mesh_name_id = scene.intern_name(batch_name(g)); //(so a baked scene can be saved alongside 'merged')
+		//(n.b. static_geometry stays false -- batches draw from 'merged', not 'meshes', so can't be re-baked)
+	}
+
+	return merged;
+}
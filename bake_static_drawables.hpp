@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+ * Static geometry baking: drawables that never move (Drawable::static_geometry) and
+ *  that share a pipeline can have their vertices pre-transformed to world space and
+ *  merged, so that each group is drawn with a single call.
+ *
+ */
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+
+#include <memory>
+#include <string>
+
+//Merge the geometry of drawables with 'static_geometry' set into world-space batches:
+// - static drawables are grouped by pipeline (program, uniforms, textures); drawables with
+//   set_uniforms or non-GL_TRIANGLES meshes are left alone, since they can't be merged, as are
+//   drawables with levels of detail (Drawable::lods), which a batch would always draw at full detail
+// - each group's vertices (read from 'meshes', which all static drawables must draw from) are
+//   transformed to world space and appended to one merged (indexed) MeshBuffer, which is returned
+//   (and which must outlive any drawing of the scene); batches are split into clusters (see build_clusters())
+// - grouped drawables are moved from scene.drawables to scene.baked_drawables, and one new
+//   drawable per group (on a new identity transform named "static batch") draws the merged geometry
+//
+// If 'cache_filename' is non-empty, merged vertices are read from that file if it was written
+//  from the same inputs (by the same version of this code -- see CacheVersion), and the file is (re-)written otherwise.
+// Returns nullptr (and leaves the scene unchanged) if there was nothing to bake.
+std::unique_ptr< MeshBuffer > bake_static_drawables(Scene &scene, MeshBuffer const &meshes, std::string const &cache_filename = "");
@@ -0,0 +1,176 @@
+/*
+ * bench-transforms measures Scene::update_transforms() on a large packed hierarchy
+ *  built from many copies of a scene, once per thread count from 1 to the number
+ *  of hardware threads.
+ *
+ * Before benchmarking, it checks that every batched TRS kernel supported by this
+ *  CPU (see make_trs.hpp) agrees with the scalar one, and that cached world matrices
+ *  (see Scene::Transform::cache_world) follow their parents, and exits with an error if not.
+ *
+ * Usage:
+ *   bench-transforms [path/to/scene.scene] [copies] [iterations]
+ *
+ */
+
+#include "Scene.hpp"
+#include "ThreadPool.hpp"
+#include "data_path.hpp"
+#include "make_trs.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//compare every supported TRS kernel against the scalar one on random transforms:
+static bool check_trs_kernels() {
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+
+	uint32_t const count = 1003; //(not a multiple of the SIMD width, so leftovers are checked too)
+	std::vector< glm::vec3 > positions(count), scales(count);
+	std::vector< glm::quat > rotations(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		positions[i] = 100.0f * glm::vec3(unit(mt), unit(mt), unit(mt));
+		rotations[i] = glm::normalize(glm::quat(unit(mt), unit(mt), unit(mt), unit(mt)));
+		if (i % 7 == 0) rotations[i] = rotations[i] * 3.0f; //non-unit quaternions should match, too
+		scales[i] = glm::vec3(unit(mt), unit(mt), unit(mt)) * 4.0f;
+		if (i % 5 == 0) scales[i].y = 0.0f; //degenerate scales should give zeros, not NaNs
+	}
+
+	auto const &kernels = get_trs_batch_kernels();
+	std::vector< glm::mat4x3 > ref(count), ref_inv(count);
+	kernels[0].fn(count, positions.data(), rotations.data(), scales.data(), ref.data(), ref_inv.data());
+
+	bool ok = true;
+	for (auto const &kernel : kernels) {
+		std::vector< glm::mat4x3 > got(count), got_inv(count);
+		kernel.fn(count, positions.data(), rotations.data(), scales.data(), got.data(), got_inv.data());
+		float max_err = 0.0f;
+		for (uint32_t i = 0; i < count; ++i) {
+			for (uint32_t c = 0; c < 4; ++c) {
+				for (uint32_t r = 0; r < 3; ++r) {
+					//relative error for large entries, absolute for small ones:
+					float scale = std::max(1.0f, std::max(std::abs(ref[i][c][r]), std::abs(ref_inv[i][c][r])));
+					max_err = std::max(max_err, std::abs(got[i][c][r] - ref[i][c][r]) / scale);
+					max_err = std::max(max_err, std::abs(got_inv[i][c][r] - ref_inv[i][c][r]) / scale);
+					if (got[i][c][r] != got[i][c][r] || got_inv[i][c][r] != got_inv[i][c][r]) max_err = INFINITY;
+				}
+			}
+		}
+		bool kernel_ok = (max_err <= 1e-5f);
+		std::cout << "TRS kernel '" << kernel.name << "': max error " << max_err << (kernel_ok ? "" : " -- FAILED") << std::endl;
+		ok = ok && kernel_ok;
+	}
+	return ok;
+}
+
+//check that cached world matrices follow a moving parent, including one that doesn't cache:
+static bool check_cached_world() {
+	bool ok = true;
+	for (bool parent_caches : {false, true}) {
+		Scene scene;
+		scene.transforms.emplace_back();
+		Scene::Transform *parent = &scene.transforms.back();
+		scene.transforms.emplace_back();
+		Scene::Transform *child = &scene.transforms.back();
+		child->set_parent(parent);
+		child->position = glm::vec3(1.0f, 0.0f, 0.0f);
+		parent->cache_world = parent_caches;
+		child->cache_world = true;
+
+		//read (and so cache) the child's matrices, then move the parent twice:
+		for (float x : {2.0f, 3.0f}) {
+			child->make_local_to_world();
+			child->make_world_to_local();
+			parent->set_position(glm::vec3(x, 0.0f, 0.0f));
+			glm::vec3 at = child->make_local_to_world()[3];
+			glm::vec3 origin = child->make_world_to_local() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			bool moved = (at == glm::vec3(x + 1.0f, 0.0f, 0.0f) && origin == glm::vec3(-(x + 1.0f), 0.0f, 0.0f));
+			if (!moved) {
+				std::cout << "Cached child of a " << (parent_caches ? "caching" : "non-caching") << " parent didn't follow it -- FAILED" << std::endl;
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	std::string scene_file = data_path("../dist/level1.scene");
+	uint32_t copies = 1000;
+	uint32_t iterations = 100;
+	if (argc > 4) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [path/to/scene.scene] [copies] [iterations]" << std::endl;
+		return 1;
+	}
+	if (argc > 1) scene_file = argv[1];
+	if (argc > 2) copies = std::max(1, std::stoi(argv[2]));
+	if (argc > 3) iterations = std::max(1, std::stoi(argv[3]));
+
+	if (!check_trs_kernels()) {
+		std::cerr << "ERROR: batched TRS kernels disagree with the scalar kernel." << std::endl;
+		return 1;
+	}
+
+	if (!check_cached_world()) {
+		std::cerr << "ERROR: cached world matrices are stale." << std::endl;
+		return 1;
+	}
+
+	//build a "city" of copies of the scene, each parented to its own root:
+	Scene scene;
+	try {
+		Scene original(scene_file, nullptr);
+		for (uint32_t c = 0; c < copies; ++c) {
+			Scene copy(original);
+
+			scene.transforms.emplace_back();
+			Scene::Transform *root = &scene.transforms.back();
+			root->name = "Copy" + std::to_string(c);
+			root->position = glm::vec3(30.0f * float(c % 32), 30.0f * float(c / 32), 0.0f);
+
+			//move transforms into the big scene, re-rooting top-level transforms:
+			auto first = copy.transforms.begin();
+			scene.transforms.splice(scene.transforms.end(), copy.transforms);
+			for (auto t = first; t != scene.transforms.end(); ++t) {
+				if (!t->parent) t->set_parent(root);
+			}
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
+		return 1;
+	}
+
+	scene.pack_transforms();
+	std::cout << "Packed " << scene.packed.size() << " transforms in " << (scene.packed.level_begin.size() - 1) << " levels." << std::endl;
+
+	uint32_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+	double single_ms = 0.0;
+	for (uint32_t threads = 1; threads <= max_threads; ++threads) {
+		std::unique_ptr< ThreadPool > pool;
+		if (threads > 1) pool.reset(new ThreadPool(threads));
+		scene.update_pool = pool.get();
+
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < iterations; ++i) {
+			//mark everything as changed (as if every root moved):
+			std::fill(scene.packed.dirty.begin(), scene.packed.dirty.end(), uint8_t(1));
+			scene.packed.pending = true;
+			scene.update_transforms();
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+
+		double ms = std::chrono::duration< double, std::milli >(after - before).count() / iterations;
+		if (threads == 1) single_ms = ms;
+		std::cout << threads << " thread(s): " << ms << " ms / update (" << (single_ms / ms) << "x)" << std::endl;
+	}
+	scene.update_pool = nullptr;
+
+	return 0;
+}
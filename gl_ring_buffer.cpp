@@ -0,0 +1,78 @@
+#include "gl_ring_buffer.hpp"
+
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+GLRingBuffer::GLRingBuffer(GLenum target_, uint32_t segments) : target(target_), fences(segments, nullptr) {
+	assert(segments > 0);
+	glGenBuffers(1, &buffer);
+	if (target == GL_UNIFORM_BUFFER) {
+		GLint uniform_alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+		alignment = std::max< GLsizeiptr >(alignment, uniform_alignment);
+	}
+}
+
+GLRingBuffer::~GLRingBuffer() {
+	for (auto &fence : fences) {
+		if (fence) glDeleteSync(fence);
+		fence = nullptr;
+	}
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+		gl_state.invalidate(); //(buffer might have been bound)
+	}
+}
+
+void *GLRingBuffer::map(GLsizeiptr size, GLintptr *offset) {
+	assert(offset);
+	gl_state.bind_buffer(target, buffer);
+
+	if (size > segment_size) {
+		//re-allocate with room to spare; orphaning the old storage means no need to wait on old fences:
+		// (each segment starts on an 'alignment' boundary)
+		segment_size = std::max< GLsizeiptr >(size + size / 2, 4096);
+		segment_size = (segment_size + alignment - 1) / alignment * alignment;
+		glBufferData(target, segment_size * GLsizeiptr(fences.size()), nullptr, GL_STREAM_DRAW);
+		for (auto &fence : fences) {
+			if (fence) glDeleteSync(fence);
+			fence = nullptr;
+		}
+		in_use = false;
+	}
+
+	//the previous segment's draws have all been issued by now, so fence it:
+	if (in_use) {
+		assert(fences[segment] == nullptr);
+		fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		in_use = false;
+	}
+
+	segment = (segment + 1) % uint32_t(fences.size());
+
+	//wait for the GPU to finish reading this segment (usually it already has):
+	if (GLsync &fence = fences[segment]) {
+		GLenum result = GL_TIMEOUT_EXPIRED;
+		while (result == GL_TIMEOUT_EXPIRED) {
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+		}
+		if (result == GL_WAIT_FAILED) throw std::runtime_error("glClientWaitSync failed in GLRingBuffer::map.");
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	*offset = segment_size * GLintptr(segment);
+	void *data = glMapBufferRange(target, *offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!data) throw std::runtime_error("glMapBufferRange failed in GLRingBuffer::map.");
+	in_use = true;
+	return data;
+}
+
+void GLRingBuffer::unmap() {
+	gl_state.bind_buffer(target, buffer);
+	glUnmapBuffer(target);
+}
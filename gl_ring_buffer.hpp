@@ -0,0 +1,43 @@
+#pragma once
+
+/*
+ * GLRingBuffer streams data that changes every frame (e.g., uniform blocks) to
+ *  the GPU without stalling on data the GPU is still reading:
+ *  each map() hands out the next of several segments of one buffer object.
+ *  Data is assumed to be in use by draws until the next map(), which drops a
+ *  fence after them so that the segment is only re-used once the GPU is done.
+ *
+ * Needs a current OpenGL context for all functions (including the constructor).
+ *
+ */
+
+#include "GL.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct GLRingBuffer {
+	GLRingBuffer(GLenum target, uint32_t segments = 3);
+	~GLRingBuffer();
+
+	//map 'size' bytes for writing; the data will be at 'offset' in 'buffer' once unmapped:
+	// (grows the buffer if needed; the returned memory is write-only)
+	void *map(GLsizeiptr size, GLintptr *offset);
+	void unmap();
+
+	GLenum target;
+	GLuint buffer = 0;
+
+	//every offset returned by map() is a multiple of this:
+	// (GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for uniform buffers, so segments can be bound with glBindBufferRange)
+	GLsizeiptr alignment = 16;
+
+	//-- internals --
+	GLsizeiptr segment_size = 0;
+	std::vector< GLsync > fences; //per-segment, set by unmap(), or nullptr if segment is free
+	uint32_t segment = 0; //segment most recently handed out by map()
+	bool in_use = false; //'segment' was handed out and hasn't been fenced yet
+
+	GLRingBuffer(GLRingBuffer const &) = delete;
+	GLRingBuffer &operator=(GLRingBuffer const &) = delete;
+};
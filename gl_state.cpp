@@ -0,0 +1,115 @@
+#include "gl_state.hpp"
+
+#include <cstddef>
+
+GLStateCache gl_state;
+
+constexpr std::array< GLenum, 8 > GLStateCache::BufferTargets;
+constexpr std::array< GLenum, 5 > GLStateCache::TextureTargets;
+
+//index of 'target' in 'targets', or targets.size() if not found:
+template< std::size_t N >
+static uint32_t target_index(std::array< GLenum, N > const &targets, GLenum target) {
+	uint32_t i = 0;
+	while (i < N && targets[i] != target) ++i;
+	return i;
+}
+
+void GLStateCache::use_program(GLuint program_) {
+	if (program_ == program) {
+		frame.skipped += 1;
+		return;
+	}
+	glUseProgram(program_);
+	program = program_;
+	frame.issued += 1;
+}
+
+void GLStateCache::bind_vertex_array(GLuint vao_) {
+	if (vao_ == vao) {
+		frame.skipped += 1;
+		return;
+	}
+	glBindVertexArray(vao_);
+	vao = vao_;
+	buffers[target_index(BufferTargets, GL_ELEMENT_ARRAY_BUFFER)] = Unknown; //(held by the vertex array)
+	frame.issued += 1;
+}
+
+void GLStateCache::bind_buffer(GLenum target, GLuint buffer) {
+	uint32_t t = target_index(BufferTargets, target);
+	if (t < BufferTargets.size()) {
+		if (buffers[t] == buffer) {
+			frame.skipped += 1;
+			return;
+		}
+		buffers[t] = buffer;
+	}
+	glBindBuffer(target, buffer);
+	frame.issued += 1;
+}
+
+void GLStateCache::bind_uniform_buffer_range(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+	if (index < UniformBufferBindings) {
+		BufferRange &range = uniform_buffer_ranges[index];
+		if (range.buffer == buffer && range.offset == offset && range.size == size) {
+			frame.skipped += 1;
+			return;
+		}
+		range.buffer = buffer;
+		range.offset = offset;
+		range.size = size;
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+	buffers[target_index(BufferTargets, GL_UNIFORM_BUFFER)] = buffer;
+	frame.issued += 1;
+}
+
+void GLStateCache::active_texture(uint32_t unit) {
+	if (unit == active) {
+		frame.skipped += 1;
+		return;
+	}
+	glActiveTexture(GL_TEXTURE0 + unit);
+	active = unit;
+	frame.issued += 1;
+}
+
+void GLStateCache::bind_texture(uint32_t unit, GLenum target, GLuint texture) {
+	uint32_t t = target_index(TextureTargets, target);
+	if (unit < TextureUnits && t < TextureTargets.size()) {
+		if (textures[unit][t] == texture) {
+			frame.skipped += 1;
+			return;
+		}
+		textures[unit][t] = texture;
+	}
+	active_texture(unit);
+	glBindTexture(target, texture);
+	frame.issued += 1;
+}
+
+void GLStateCache::unbind_textures(uint32_t unit) {
+	if (unit >= TextureUnits) return;
+	for (uint32_t t = 0; t < TextureTargets.size(); ++t) {
+		if (textures[unit][t] != 0) bind_texture(unit, TextureTargets[t], 0);
+	}
+}
+
+void GLStateCache::invalidate() {
+	program = Unknown;
+	vao = Unknown;
+	buffers.fill(Unknown);
+	for (auto &range : uniform_buffer_ranges) {
+		range.buffer = Unknown;
+	}
+	active = Unknown;
+	for (auto &unit : textures) {
+		unit.fill(Unknown);
+	}
+}
+
+void GLStateCache::new_frame() {
+	last_frame = frame;
+	frame = Counters();
+}
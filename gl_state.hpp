@@ -0,0 +1,74 @@
+#pragma once
+
+/*
+ * GLStateCache remembers the current program, vertex array, buffer bindings
+ *  (including uniform block binding points), active texture unit, and per-unit texture bindings, so that calls which would
+ *  not change anything can be skipped.
+ *
+ * For this to work, *all* code that changes these bindings must go through
+ *  'gl_state' (below). If some code does bind things directly -- or deletes an
+ *  object that is currently bound -- call gl_state.invalidate() afterward.
+ *
+ */
+
+#include "GL.hpp"
+
+#include <array>
+#include <cstdint>
+
+struct GLStateCache {
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint vao);
+	//(n.b. the GL_ELEMENT_ARRAY_BUFFER binding is part of vertex array state, so it is forgotten by bind_vertex_array)
+	void bind_buffer(GLenum target, GLuint buffer);
+	//binds [offset,offset+size) of 'buffer' to uniform block binding point 'index':
+	// (like glBindBufferRange, this also sets the GL_UNIFORM_BUFFER binding)
+	void bind_uniform_buffer_range(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	//binds 'texture' to 'target' of texture unit 'unit' (changing the active texture unit if needed):
+	void bind_texture(uint32_t unit, GLenum target, GLuint texture);
+	//un-binds whatever textures are bound to texture unit 'unit':
+	void unbind_textures(uint32_t unit);
+	void active_texture(uint32_t unit);
+
+	//forget all cached state (next call of each kind will always be issued):
+	void invalidate();
+
+	//counts of calls passed on to OpenGL vs. dropped because they would change nothing:
+	struct Counters {
+		uint32_t issued = 0;
+		uint32_t skipped = 0;
+	};
+	Counters frame; //since the last new_frame()
+	Counters last_frame; //the frame before that
+
+	//called once per frame by the main loop, before drawing:
+	void new_frame();
+
+	//-- internals --
+	enum : GLuint { Unknown = ~GLuint(0) };
+	enum : uint32_t { TextureUnits = 16 };
+	enum : uint32_t { UniformBufferBindings = 16 };
+
+	//bindings start at OpenGL's initial values (everything zero):
+	GLuint program = 0;
+	GLuint vao = 0;
+	static constexpr std::array< GLenum, 8 > BufferTargets{{
+		GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_TEXTURE_BUFFER,
+		GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER
+	}};
+	std::array< GLuint, BufferTargets.size() > buffers{};
+	struct BufferRange {
+		GLuint buffer = 0;
+		GLintptr offset = 0;
+		GLsizeiptr size = 0;
+	};
+	std::array< BufferRange, UniformBufferBindings > uniform_buffer_ranges{};
+	static constexpr std::array< GLenum, 5 > TextureTargets{{
+		GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER
+	}};
+	uint32_t active = 0;
+	std::array< std::array< GLuint, TextureTargets.size() >, TextureUnits > textures{};
+};
+
+extern GLStateCache gl_state;
@@ -0,0 +1,162 @@
+#include "gl_thread.hpp"
+
+#include "gl_state.hpp"
+#include "GL.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+GLThread::GLThread(SDL_Window *window_, SDL_GLContext context_) : window(window_), context(context_) {
+	//a context can only be current on one thread at a time:
+	if (SDL_GL_MakeCurrent(window, nullptr) != 0) {
+		throw std::runtime_error("Failed to release OpenGL context: " + std::string(SDL_GetError()));
+	}
+
+	bool started = false;
+	thread = std::thread([this, &started](){
+		std::unique_lock< std::mutex > lock(mutex);
+		if (SDL_GL_MakeCurrent(window, context) != 0) {
+			error = std::make_exception_ptr(std::runtime_error("Failed to make OpenGL context current on GL thread: " + std::string(SDL_GetError())));
+			cv.notify_all();
+			return;
+		}
+		gl_state.invalidate(); //(be safe about what bindings the main thread left behind)
+		started = true;
+		cv.notify_all();
+
+		while (true) {
+			cv.wait(lock, [this](){ return quit || !jobs.empty(); });
+			if (jobs.empty()) break; //(quit, and nothing left to do)
+			std::function< void() > job = std::move(jobs.front());
+			jobs.pop_front();
+
+			lock.unlock();
+			job(); //(jobs catch their own exceptions)
+			job = nullptr; //(release whatever the job held while still on this thread)
+			lock.lock();
+			cv.notify_all();
+		}
+		lock.unlock();
+
+		SDL_GL_MakeCurrent(window, nullptr);
+	});
+
+	//wait for the context to be current over there:
+	std::unique_lock< std::mutex > lock(mutex);
+	cv.wait(lock, [&](){ return started || error; });
+	if (!started) {
+		lock.unlock();
+		thread.join();
+		SDL_GL_MakeCurrent(window, context);
+		std::rethrow_exception(error);
+	}
+}
+
+GLThread::~GLThread() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+		cv.notify_all();
+	}
+	thread.join();
+
+	if (SDL_GL_MakeCurrent(window, context) != 0) {
+		std::cerr << "WARNING: failed to make OpenGL context current again: " << SDL_GetError() << std::endl;
+	}
+	gl_state.invalidate();
+}
+
+void GLThread::push(std::function< void() > const &job) {
+	std::unique_lock< std::mutex > lock(mutex);
+	assert(!quit);
+	jobs.emplace_back(job);
+	cv.notify_all();
+}
+
+void GLThread::wait_for(std::unique_lock< std::mutex > &lock, std::function< bool() > const &done) {
+	auto before = Clock::now();
+	cv.wait(lock, done);
+	totals.main_waiting += std::chrono::duration< double >(Clock::now() - before).count();
+	if (error) {
+		std::exception_ptr e = error;
+		error = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+RenderCommands &GLThread::begin_frame() {
+	std::unique_lock< std::mutex > lock(mutex);
+	uint32_t index = recording;
+	wait_for(lock, [this, index](){ return !busy[index]; });
+	return frames[index];
+}
+
+void GLThread::submit() {
+	uint32_t index = recording;
+	recording = 1 - recording;
+	bool wait = frames[index].wait;
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		busy[index] = true;
+	}
+
+	auto submitted = Clock::now();
+	push([this, index, submitted](){
+		RenderCommands &commands = frames[index];
+
+		//each frame starts from a known viewport and fresh gl_state counters:
+		glViewport(commands.viewport[0], commands.viewport[1], commands.viewport[2], commands.viewport[3]);
+		gl_state.new_frame();
+
+		auto before_execute = Clock::now();
+		auto before_swap = before_execute;
+		std::exception_ptr failed;
+		try {
+			commands.execute();
+			before_swap = Clock::now();
+			SDL_GL_SwapWindow(window);
+		} catch (...) {
+			failed = std::current_exception();
+		}
+		auto after_swap = Clock::now();
+
+		commands.clear();
+
+		std::unique_lock< std::mutex > lock(mutex);
+		if (failed && !error) error = failed;
+		busy[index] = false;
+		totals.frames += 1;
+		totals.executing += std::chrono::duration< double >(before_swap - before_execute).count();
+		totals.swapping += std::chrono::duration< double >(after_swap - before_swap).count();
+		totals.latency += std::chrono::duration< double >(after_swap - submitted).count();
+	});
+
+	if (wait) {
+		std::unique_lock< std::mutex > lock(mutex);
+		wait_for(lock, [this, index](){ return !busy[index]; });
+	}
+}
+
+void GLThread::run(std::function< void() > const &fn) {
+	bool done = false;
+	push([this, &fn, &done](){
+		std::exception_ptr failed;
+		try {
+			fn();
+		} catch (...) {
+			failed = std::current_exception();
+		}
+		std::unique_lock< std::mutex > lock(mutex);
+		if (failed && !error) error = failed;
+		done = true;
+	});
+	std::unique_lock< std::mutex > lock(mutex);
+	wait_for(lock, [&done](){ return done; });
+}
+
+GLThread::Stats GLThread::stats() {
+	std::unique_lock< std::mutex > lock(mutex);
+	return totals;
+}
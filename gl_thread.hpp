@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * GLThread makes all OpenGL calls for a window on a thread of its own, so
+ *  that the main thread can handle events and update frame N+1 while frame
+ *  N's commands are executed and presented.
+ *
+ * Frames are double-buffered: the main thread records into the list from
+ *  begin_frame() and hands it off with submit(); the GL thread executes it
+ *  (with glViewport set to the list's viewport), swaps the window, and then
+ *  clears the list -- so anything the list's callbacks hold is released on the
+ *  GL thread. begin_frame() waits until its list is free again, so at most one
+ *  frame is ever in flight.
+ *
+ * One-off OpenGL work (finishing loads, screenshots, modes that draw directly)
+ *  can be done with run(), which waits for it.
+ *
+ */
+
+#include "render_commands.hpp"
+
+#include <SDL.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct GLThread {
+	//take over 'context' (which must be current on the calling thread) for a new thread:
+	GLThread(SDL_Window *window, SDL_GLContext context);
+	//finish all work, then make 'context' current on the calling thread again:
+	~GLThread();
+
+	//the command list to record the next frame into (waits until it is free; it starts out cleared):
+	RenderCommands &begin_frame();
+
+	//execute the list from begin_frame() and swap the window:
+	// returns right away, unless the list's 'wait' flag is set, in which case it waits for the swap.
+	void submit();
+
+	//run 'fn' on the GL thread after everything submitted so far, and wait for it:
+	// (exceptions thrown by 'fn' -- or by earlier frames -- are re-thrown here)
+	void run(std::function< void() > const &fn);
+
+	//timings, summed over all frames so far (in seconds):
+	struct Stats {
+		uint32_t frames = 0;
+		double main_waiting = 0.0; //main thread blocked in begin_frame(), submit(), or run()
+		double executing = 0.0; //GL thread in RenderCommands::execute()
+		double swapping = 0.0; //GL thread in SDL_GL_SwapWindow()
+		double latency = 0.0; //from submit() to the end of the frame's swap
+	};
+	Stats stats();
+
+	//-- internals --
+	typedef std::chrono::high_resolution_clock Clock;
+
+	SDL_Window *window;
+	SDL_GLContext context;
+
+	RenderCommands frames[2];
+	bool busy[2] = {false, false}; //submitted and not yet executed
+	uint32_t recording = 0; //index of the list begin_frame() hands out
+
+	std::mutex mutex; //guards everything below
+	std::condition_variable cv;
+	std::deque< std::function< void() > > jobs;
+	bool quit = false;
+	std::exception_ptr error; //first exception thrown by a job, re-thrown on the main thread
+	Stats totals;
+
+	std::thread thread;
+
+	void push(std::function< void() > const &job);
+	void wait_for(std::unique_lock< std::mutex > &lock, std::function< bool() > const &done); //(also re-throws 'error')
+
+	GLThread(GLThread const &) = delete;
+	GLThread &operator=(GLThread const &) = delete;
+};
@@ -0,0 +1,236 @@
+#include "light_clusters.hpp"
+
+#include "gl_state.hpp"
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLUSTERS_SSE2
+#include <emmintrin.h>
+#endif
+
+LightClusters::~LightClusters() {
+	if (textures[0]) glDeleteTextures(3, textures);
+	if (buffers[0]) glDeleteBuffers(3, buffers);
+	if (textures[0] || buffers[0]) gl_state.invalidate(); //(textures and buffers might have been bound)
+}
+
+void LightClusters::build(std::vector< Light > const &all_lights, glm::mat4x3 const &light_to_view, glm::mat4 const &projection, float near, float far) {
+	far = std::max(far, 2.0f * near); //(slices need some depth to cover)
+	lights.clear();
+	clusters.assign(Count, glm::uvec2(0));
+	indices.clear();
+	stats = Stats();
+
+	depth_scale = float(Slices) / std::log(far / near);
+	depth_bias = -std::log(near) * depth_scale;
+
+	//view = projection scale factors (view x = ndc x * depth / p00, and similarly for y):
+	float p00 = projection[0][0];
+	float p11 = projection[1][1];
+
+	//cluster bounds in view space:
+	// slice s covers depths [slice_depth[s], slice_depth[s+1]] (i.e., view z in [-slice_depth[s+1], -slice_depth[s]]);
+	// tile x of slice s covers view x in [tile_min_x[s*TilesX+x], tile_max_x[s*TilesX+x]] (and similarly for y):
+	float slice_depth[Slices + 1];
+	for (uint32_t s = 0; s <= Slices; ++s) {
+		slice_depth[s] = near * std::pow(far / near, float(s) / float(Slices));
+	}
+	//(the last slice holds everything beyond, so it reaches as far as any light does)
+	for (auto const &light : all_lights) {
+		float depth = -(light_to_view * glm::vec4(light.position, 1.0f)).z + light.radius;
+		slice_depth[Slices] = std::max(slice_depth[Slices], depth);
+	}
+	alignas(16) float tile_min_x[Slices * TilesX], tile_max_x[Slices * TilesX];
+	float tile_min_y[Slices * TilesY], tile_max_y[Slices * TilesY];
+	for (uint32_t s = 0; s < Slices; ++s) {
+		float d0 = slice_depth[s], d1 = slice_depth[s+1];
+		for (uint32_t x = 0; x < TilesX; ++x) {
+			float n0 = -1.0f + 2.0f * float(x) / float(TilesX);
+			float n1 = -1.0f + 2.0f * float(x + 1) / float(TilesX);
+			tile_min_x[s * TilesX + x] = std::min(n0 * d0, n0 * d1) / p00;
+			tile_max_x[s * TilesX + x] = std::max(n1 * d0, n1 * d1) / p00;
+		}
+		for (uint32_t y = 0; y < TilesY; ++y) {
+			float n0 = -1.0f + 2.0f * float(y) / float(TilesY);
+			float n1 = -1.0f + 2.0f * float(y + 1) / float(TilesY);
+			tile_min_y[s * TilesY + y] = std::min(n0 * d0, n0 * d1) / p11;
+			tile_max_y[s * TilesY + y] = std::max(n1 * d0, n1 * d1) / p11;
+		}
+	}
+
+	//(cluster, light) pairs, later sorted into per-cluster lists:
+	pair_cluster.clear();
+	pair_light.clear();
+
+	for (auto const &light : all_lights) {
+		glm::vec3 center = light_to_view * glm::vec4(light.position, 1.0f);
+		float r = light.radius;
+
+		//depth range, skipping lights entirely in front of the near plane:
+		float depth_min = std::max(near, -center.z - r);
+		float depth_max = -center.z + r;
+		if (depth_max < near) continue;
+
+		//screen (ndc) bounds of the light's view-space box; x/depth is monotonic in both, so corners suffice:
+		float ndc_min_x = std::min(std::min((center.x - r) / depth_min, (center.x - r) / depth_max), std::min((center.x + r) / depth_min, (center.x + r) / depth_max)) * p00;
+		float ndc_max_x = std::max(std::max((center.x - r) / depth_min, (center.x - r) / depth_max), std::max((center.x + r) / depth_min, (center.x + r) / depth_max)) * p00;
+		float ndc_min_y = std::min(std::min((center.y - r) / depth_min, (center.y - r) / depth_max), std::min((center.y + r) / depth_min, (center.y + r) / depth_max)) * p11;
+		float ndc_max_y = std::max(std::max((center.y - r) / depth_min, (center.y - r) / depth_max), std::max((center.y + r) / depth_min, (center.y + r) / depth_max)) * p11;
+		if (ndc_max_x < -1.0f || ndc_min_x > 1.0f || ndc_max_y < -1.0f || ndc_min_y > 1.0f) continue;
+
+		auto to_tile = [](float ndc, uint32_t tiles) {
+			return uint32_t(std::min(std::max(std::floor((ndc * 0.5f + 0.5f) * float(tiles)), 0.0f), float(tiles - 1)));
+		};
+		auto to_slice = [this](float depth) {
+			return uint32_t(std::min(std::max(std::floor(std::log(depth) * depth_scale + depth_bias), 0.0f), float(Slices - 1)));
+		};
+		uint32_t x0 = to_tile(ndc_min_x, TilesX), x1 = to_tile(ndc_max_x, TilesX);
+		uint32_t y0 = to_tile(ndc_min_y, TilesY), y1 = to_tile(ndc_max_y, TilesY);
+		uint32_t s0 = to_slice(depth_min), s1 = to_slice(depth_max);
+
+		//spot lights are also tested against the cone (using each cluster's bounding sphere):
+		bool spot = (light.type == 2.0f);
+		glm::vec3 direction = (spot ? glm::normalize(glm::mat3(light_to_view) * light.direction) : glm::vec3(0.0f));
+		float cone_cos = light.cutoff;
+		float cone_sin = std::sqrt(std::max(0.0f, 1.0f - cone_cos * cone_cos));
+
+		uint32_t light_index = uint32_t(lights.size());
+		uint32_t before = uint32_t(pair_cluster.size());
+
+		auto add = [&](uint32_t s, uint32_t y, uint32_t x) {
+			pair_cluster.emplace_back((s * TilesY + y) * TilesX + x);
+			pair_light.emplace_back(light_index);
+		};
+
+		for (uint32_t s = s0; s <= s1; ++s) {
+			//z distance from the light to the slice:
+			float dz = std::max(std::max(-slice_depth[s+1] - center.z, center.z + slice_depth[s]), 0.0f);
+			for (uint32_t y = y0; y <= y1; ++y) {
+				float dy = std::max(std::max(tile_min_y[s * TilesY + y] - center.y, center.y - tile_max_y[s * TilesY + y]), 0.0f);
+				float remaining = r * r - dz * dz - dy * dy; //(sphere/box test leaves this much for dx^2)
+				if (remaining < 0.0f) continue;
+
+				//cone test terms shared by the row -- a cluster's bounding sphere is culled if it lies entirely
+				// outside the cone ('closest' is the distance from its center to the cone's surface):
+				float min_y = tile_min_y[s * TilesY + y], max_y = tile_max_y[s * TilesY + y];
+				float min_z = -slice_depth[s+1], max_z = -slice_depth[s];
+				float vy = 0.5f * (min_y + max_y) - center.y, vz = 0.5f * (min_z + max_z) - center.z;
+				float wy = max_y - min_y, wz = max_z - min_z;
+
+				#ifdef CLUSTERS_SSE2
+				//sphere-vs-box (and, for spot lights, cone) tests four tiles at a time:
+				__m128 cx = _mm_set1_ps(center.x);
+				__m128 rem = _mm_set1_ps(remaining);
+				__m128 zero = _mm_setzero_ps();
+				__m128 half = _mm_set1_ps(0.5f);
+				for (uint32_t x4 = x0 & ~3U; x4 <= x1; x4 += 4) {
+					__m128 lo = _mm_load_ps(tile_min_x + s * TilesX + x4);
+					__m128 hi = _mm_load_ps(tile_max_x + s * TilesX + x4);
+					__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(lo, cx), _mm_sub_ps(cx, hi)), zero);
+					__m128 inside = _mm_cmple_ps(_mm_mul_ps(dx, dx), rem);
+					if (spot) {
+						__m128 vx = _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(lo, hi)), cx);
+						__m128 wx = _mm_sub_ps(hi, lo);
+						__m128 sphere_radius = _mm_mul_ps(half, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, wx), _mm_set1_ps(wy * wy)), _mm_set1_ps(wz * wz))));
+						__m128 v_len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_set1_ps(vy * vy)), _mm_set1_ps(vz * vz));
+						__m128 v_along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(direction.x)), _mm_set1_ps(vy * direction.y)), _mm_set1_ps(vz * direction.z));
+						__m128 closest = _mm_sub_ps(
+							_mm_mul_ps(_mm_set1_ps(cone_cos), _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(v_len2, _mm_mul_ps(v_along, v_along))))),
+							_mm_mul_ps(v_along, _mm_set1_ps(cone_sin))
+						);
+						__m128 culled = _mm_or_ps(_mm_or_ps(
+							_mm_cmpgt_ps(closest, sphere_radius),
+							_mm_cmpgt_ps(v_along, _mm_add_ps(sphere_radius, _mm_set1_ps(r)))),
+							_mm_cmplt_ps(v_along, _mm_sub_ps(zero, sphere_radius))
+						);
+						inside = _mm_andnot_ps(culled, inside);
+					}
+					int hit = _mm_movemask_ps(inside);
+					for (uint32_t i = 0; i < 4; ++i) {
+						uint32_t x = x4 + i;
+						if ((hit & (1 << i)) && x >= x0 && x <= x1) add(s, y, x);
+					}
+				}
+				#else
+				for (uint32_t x = x0; x <= x1; ++x) {
+					float min_x = tile_min_x[s * TilesX + x], max_x = tile_max_x[s * TilesX + x];
+					float dx = std::max(std::max(min_x - center.x, center.x - max_x), 0.0f);
+					if (dx * dx > remaining) continue;
+					if (spot) {
+						float vx = 0.5f * (min_x + max_x) - center.x;
+						float wx = max_x - min_x;
+						float sphere_radius = 0.5f * std::sqrt(wx * wx + wy * wy + wz * wz);
+						float v_len2 = vx * vx + vy * vy + vz * vz;
+						float v_along = vx * direction.x + vy * direction.y + vz * direction.z;
+						float closest = cone_cos * std::sqrt(std::max(0.0f, v_len2 - v_along * v_along)) - v_along * cone_sin;
+						if (closest > sphere_radius || v_along > sphere_radius + r || v_along < -sphere_radius) continue;
+					}
+					add(s, y, x);
+				}
+				#endif
+			}
+		}
+
+		if (pair_cluster.size() != before) lights.emplace_back(light);
+	}
+
+	//sort pairs into per-cluster lists (counting sort, so each list stays in light order):
+	for (uint32_t c : pair_cluster) {
+		clusters[c].y += 1;
+	}
+	uint32_t total = 0;
+	for (auto &cluster : clusters) {
+		cluster.x = total;
+		total += cluster.y;
+		stats.max_per_cluster = std::max(stats.max_per_cluster, cluster.y);
+		cluster.y = 0; //(re-counted below)
+	}
+	indices.resize(total);
+	for (uint32_t i = 0; i < pair_cluster.size(); ++i) {
+		glm::uvec2 &cluster = clusters[pair_cluster[i]];
+		indices[cluster.x + cluster.y] = pair_light[i];
+		cluster.y += 1;
+	}
+
+	stats.lights = uint32_t(lights.size());
+	stats.references = total;
+}
+
+void LightClusters::upload() {
+	if (clusters.size() != Count) clusters.assign(Count, glm::uvec2(0)); //(not built yet)
+	upload(lights.data(), uint32_t(lights.size()), clusters.data(), indices.data(), uint32_t(indices.size()));
+}
+
+void LightClusters::upload(Light const *lights_, uint32_t light_count, glm::uvec2 const *clusters_, uint32_t const *indices_, uint32_t index_count) {
+	if (buffers[0] == 0) {
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+		GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+		for (uint32_t i = 0; i < 3; ++i) {
+			gl_state.bind_buffer(GL_TEXTURE_BUFFER, buffers[i]);
+			glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW); //(buffer textures need a data store)
+			gl_state.bind_texture(LightsTextureUnit + i, GL_TEXTURE_BUFFER, textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		}
+	}
+
+	//(re-)specify each buffer's data, which also orphans the previous frame's:
+	auto upload_buffer = [](GLuint buffer, GLsizeiptr size, void const *data) {
+		gl_state.bind_buffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, std::max< GLsizeiptr >(size, 16), (size ? data : nullptr), GL_STREAM_DRAW);
+	};
+	upload_buffer(buffers[0], light_count * sizeof(Light), lights_);
+	upload_buffer(buffers[1], Count * sizeof(glm::uvec2), clusters_);
+	upload_buffer(buffers[2], index_count * sizeof(uint32_t), indices_);
+
+	GL_ERRORS();
+}
+
+void LightClusters::bind() const {
+	for (uint32_t i = 0; i < 3; ++i) {
+		gl_state.bind_texture(LightsTextureUnit + i, GL_TEXTURE_BUFFER, textures[i]);
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ * LightClusters bins point and spot lights into a grid of view-space
+ *  "clusters" (screen tiles x logarithmic depth slices), so that shaders can
+ *  loop over only the lights that might reach each fragment.
+ *
+ * build() does the binning on the CPU (no OpenGL calls); upload() copies the
+ *  results into three buffer textures, which programs read as:
+ *   samplerBuffer LIGHTS -- three texels per light (see Light, below)
+ *   usamplerBuffer CLUSTERS -- (first, count) range of CLUSTER_LIGHTS per cluster
+ *   usamplerBuffer CLUSTER_LIGHTS -- light indices
+ *  with the grid parameters in Scene's "Frame" uniform block.
+ *
+ * (Scene::draw(Camera) does all of this for the scene's lights.)
+ *
+ */
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct LightClusters {
+	LightClusters() = default;
+	~LightClusters();
+
+	//grid size -- tiles evenly divide the viewport; slices are spaced logarithmically in depth from 'near' to 'far' (see build()):
+	enum : uint32_t {
+		TilesX = 16, //(multiple of four; tiles are tested four at a time)
+		TilesY = 9,
+		Slices = 24,
+		Count = TilesX * TilesY * Slices,
+	};
+
+	//texture units the buffer textures are bound to:
+	// (above Scene::Drawable::Pipeline::TextureCount, so per-drawable textures don't disturb them)
+	enum : uint32_t {
+		LightsTextureUnit = 4,
+		ClustersTextureUnit = 5,
+		ClusterLightsTextureUnit = 6,
+	};
+
+	//lights as stored in the LIGHTS buffer texture (in the space shading is done in, i.e., "light space"):
+	struct Light {
+		glm::vec3 position;
+		float radius; //no light reaches past this distance
+		glm::vec3 energy;
+		float type; //0: point, 2: spot (as in Scene::FrameUniforms::light_type; a float, since it's stored in an RGBA32F texel)
+		glm::vec3 direction; //(spot) direction the light points
+		float cutoff; //(spot) cosine of half the cone angle
+	};
+	static_assert(sizeof(Light) == 3 * 16, "Light is three RGBA32F texels.");
+
+	//bin 'lights' for a view:
+	// light_to_view takes light positions/directions to view space (camera looking along -z),
+	// 'projection' is a symmetric perspective projection (as from Scene::Camera::make_projection()),
+	// 'near' is its near plane distance, and 'far' is where the last slice ends (lights beyond it are binned into the last slice;
+	// Scene::record() uses the farthest depth its lights reach, so the slices only cover depths that can be lit).
+	void build(std::vector< Light > const &lights, glm::mat4x3 const &light_to_view, glm::mat4 const &projection, float near, float far);
+
+	//copy the results of build() into buffer textures (creates them on first call):
+	void upload();
+	//..or copy results saved from an earlier build() (as RenderCommands does, so build() can run again before they are uploaded):
+	void upload(Light const *lights, uint32_t light_count, glm::uvec2 const *clusters, uint32_t const *indices, uint32_t index_count);
+
+	//bind the buffer textures to their texture units (via gl_state):
+	void bind() const;
+
+	//results of build():
+	std::vector< Light > lights;
+	std::vector< glm::uvec2 > clusters; //(first, count) in 'indices', for cluster (slice * TilesY + tile_y) * TilesX + tile_x
+	std::vector< uint32_t > indices; //indices into 'lights'
+
+	//slice of a fragment at view depth d is floor(log(d) * depth_scale + depth_bias):
+	float depth_scale = 0.0f;
+	float depth_bias = 0.0f;
+
+	//counts from the most recent build():
+	struct Stats {
+		uint32_t lights = 0; //lights that were in view
+		uint32_t references = 0; //total light references in all clusters
+		uint32_t max_per_cluster = 0;
+	} stats;
+
+	//-- internals --
+	GLuint buffers[3] = {0, 0, 0}; //lights, clusters, indices
+	GLuint textures[3] = {0, 0, 0};
+	std::vector< uint32_t > pair_cluster, pair_light; //scratch for build(): (cluster, light) pairs, kept so re-building doesn't allocate
+
+	LightClusters(LightClusters const &) = delete;
+	LightClusters &operator=(LightClusters const &) = delete;
+};
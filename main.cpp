@@ -4,6 +4,9 @@
 //The 'PlayMode' mode plays the game:
 #include "PlayMode.hpp"
 
+//The 'LoadingMode' mode shows progress while assets load:
+#include "LoadingMode.hpp"
+
 //For asset loading:
 #include "Load.hpp"
 
@@ -13,6 +16,9 @@
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
+//OpenGL calls are made on their own thread:
+#include "gl_thread.hpp"
+
 //for screenshots:
 #include "load_save_png.hpp"
 
@@ -96,10 +102,13 @@ int main(int argc, char **argv) {
 	Sound::init();
 
 	//------------ load assets --------------
-	call_load_functions();
+	//(file parsing runs on worker threads; LoadingMode finishes loading between frames)
+	start_load_functions();
 
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >());
+	Mode::set_current(std::make_shared< LoadingMode >([](){
+		return std::make_shared< PlayMode >();
+	}));
 
 	//------------ main loop ------------
 
@@ -108,16 +117,35 @@ int main(int argc, char **argv) {
 	glm::uvec2 window_size; //size of window (layout pixels)
 	glm::uvec2 drawable_size; //size of drawable (physical pixels)
 	//On non-highDPI displays, window_size will always equal drawable_size.
+	//(n.b. the GL thread sets the viewport from each frame's commands)
 	auto on_resize = [&](){
 		int w,h;
 		SDL_GetWindowSize(window, &w, &h);
 		window_size = glm::uvec2(w, h);
 		SDL_GL_GetDrawableSize(window, &w, &h);
 		drawable_size = glm::uvec2(w, h);
-		glViewport(0, 0, drawable_size.x, drawable_size.y);
 	};
 	on_resize();
 
+	//From here on, OpenGL calls happen on a separate thread, which executes (and presents)
+	// each frame's recorded commands while this thread handles events and updates for the next:
+	std::unique_ptr< GLThread > gl_thread(new GLThread(window, context));
+
+	//modes that don't record() their own commands run update() and draw() on the GL thread, in lock-step:
+	bool lockstep = true;
+
+	//modes are released on the GL thread, since they may free OpenGL objects when destroyed:
+	std::shared_ptr< Mode > previous_mode = Mode::current;
+	auto retire_previous_mode = [&](){
+		if (previous_mode == Mode::current) return;
+		gl_thread->run([&previous_mode](){ previous_mode.reset(); });
+		previous_mode = Mode::current;
+		lockstep = true; //(until the new mode records a frame)
+	};
+
+	//timing of the main thread's part of each frame (for the summary printed at exit):
+	double main_busy = 0.0;
+
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
 		//every pass through the game loop creates one frame of output
@@ -140,21 +168,26 @@ int main(int argc, char **argv) {
 					// --- screenshot key ---
 					std::string filename = "screenshot.png";
 					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-					glReadBuffer(GL_FRONT);
 					int w,h;
 					SDL_GL_GetDrawableSize(window, &w, &h);
 					std::vector< glm::u8vec4 > data(w*h);
-					glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+					gl_thread->run([&](){
+						glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+						glReadBuffer(GL_FRONT);
+						glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+					});
 					for (auto &px : data) {
 						px.a = 0xff;
 					}
 					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
 				}
 			}
+			retire_previous_mode();
 			if (!Mode::current) break;
 		}
 
+		auto frame_start = std::chrono::high_resolution_clock::now();
+
 		{ //(2) call the current mode's "update" function to deal with elapsed time:
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
@@ -165,17 +198,42 @@ int main(int argc, char **argv) {
 			//lag to avoid spiral of death:
 			elapsed = std::min(0.1f, elapsed);
 
-			Mode::current->update(elapsed);
+			if (lockstep) {
+				gl_thread->run([&](){ Mode::current->update(elapsed); });
+			} else {
+				Mode::current->update(elapsed);
+			}
+			retire_previous_mode();
 			if (!Mode::current) break;
 		}
 
-		{ //(3) call the current mode's "draw" function to produce output:
-		
-			Mode::current->draw(drawable_size);
+		{ //(3) call the current mode's "record" function to produce output:
+			RenderCommands &commands = gl_thread->begin_frame();
+			commands.viewport = glm::ivec4(0, 0, drawable_size.x, drawable_size.y);
+			Mode::current->record(drawable_size, &commands);
+			lockstep = commands.wait;
+
+			//the GL thread executes the commands and then waits until the frame is shown:
+			gl_thread->submit();
 		}
 
-		//Wait until the recently-drawn frame is shown before doing it all again:
-		SDL_GL_SwapWindow(window);
+		main_busy += std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - frame_start).count();
+	}
+
+	{ //finish up on the GL thread and report how much its work overlapped with this thread's:
+		gl_thread->run([](){}); //(waits for the last frame)
+		GLThread::Stats stats = gl_thread->stats();
+		gl_thread.reset();
+		if (stats.frames) {
+			double gl_busy = stats.executing + stats.swapping;
+			double overlap = std::max(0.0, gl_busy - stats.main_waiting);
+			std::cout << "Frame timing (averages over " << stats.frames << " frames): "
+				<< "main thread " << (1000.0 * (main_busy - stats.main_waiting) / stats.frames) << " ms, "
+				<< "GL execute " << (1000.0 * stats.executing / stats.frames) << " ms, "
+				<< "swap " << (1000.0 * stats.swapping / stats.frames) << " ms, "
+				<< "submit-to-present latency " << (1000.0 * stats.latency / stats.frames) << " ms; "
+				<< "GL thread overlapped the main thread for " << (gl_busy > 0.0 ? 100.0 * overlap / gl_busy : 0.0) << "% of its work." << std::endl;
+		}
 	}
 
 
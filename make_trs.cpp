@@ -0,0 +1,365 @@
+#include "make_trs.hpp"
+
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+//MSVC allows intrinsics for any instruction set without extra flags:
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+//...while gcc/clang need to be told which functions may use them:
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+//the SIMD kernels load quaternions directly from memory, and (like the scene file) expect xyzw order:
+static_assert(sizeof(glm::quat) == 4 * 4, "quaternions are packed");
+static_assert(sizeof(glm::mat4x3) == 4 * 3 * 4, "4x3 matrices are packed");
+
+glm::mat4x3 make_trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	//compute:
+	//   translate   *   rotate    *   scale
+	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
+	// [ 0 1 0 p.y ] * [ rot   0 ] * [ 0 s.y 0 0 ]
+	// [ 0 0 1 p.z ]   [       0 ]   [ 0 0 s.z 0 ]
+	//                 [ 0 0 0 1 ]   [ 0 0   0 1 ]
+
+	glm::mat3 rot = glm::mat3_cast(rotation);
+	return glm::mat4x3(
+		rot[0] * scale.x, //scaling the columns here means that scale happens before rotation
+		rot[1] * scale.y,
+		rot[2] * scale.z,
+		position
+	);
+}
+
+glm::mat4x3 make_inverse_trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	//compute:
+	//   1/scale       *    rot^-1   *  translate^-1
+	// [ 1/s.x 0 0 0 ]   [       0 ]   [ 0 0 0 -p.x ]
+	// [ 0 1/s.y 0 0 ] * [rot^-1 0 ] * [ 0 0 0 -p.y ]
+	// [ 0 0 1/s.z 0 ]   [       0 ]   [ 0 0 0 -p.z ]
+	//                   [ 0 0 0 1 ]   [ 0 0 0  1   ]
+
+	glm::vec3 inv_scale;
+	//taking some care so that we don't end up with NaN's , just a degenerate matrix, if scale is zero:
+	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
+	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
+	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
+
+	//compute inverse of rotation:
+	glm::mat3 inv_rot = glm::mat3_cast(glm::inverse(rotation));
+
+	//scale the rows of rot:
+	inv_rot[0] *= inv_scale;
+	inv_rot[1] *= inv_scale;
+	inv_rot[2] *= inv_scale;
+
+	return glm::mat4x3(
+		inv_rot[0],
+		inv_rot[1],
+		inv_rot[2],
+		inv_rot * -position
+	);
+}
+
+//-------------------------
+
+static void make_trs_batch_scalar(uint32_t count,
+	glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales,
+	glm::mat4x3 *trs, glm::mat4x3 *inverse_trs) {
+	for (uint32_t i = 0; i < count; ++i) {
+		if (trs) trs[i] = make_trs(positions[i], rotations[i], scales[i]);
+		if (inverse_trs) inverse_trs[i] = make_inverse_trs(positions[i], rotations[i], scales[i]);
+	}
+}
+
+#ifdef TRS_X86
+
+//Both SIMD kernels work on "lanes" of transforms at once: each register holds the same
+// component (e.g., rotation.x) of several transforms. The math mirrors make_trs/make_inverse_trs,
+// with mat3_cast expanded:
+//   [ 1-2(yy+zz)  2(xy-wz)    2(xz+wy)   ]
+//   [ 2(xy+wz)    1-2(xx+zz)  2(yz-wx)   ]
+//   [ 2(xz-wy)    2(yz+wx)    1-2(xx+yy) ]
+
+TARGET_SSE41 static void make_trs_batch_sse41(uint32_t count,
+	glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales,
+	glm::mat4x3 *trs, glm::mat4x3 *inverse_trs) {
+
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		glm::vec3 const *p = positions + i;
+		glm::vec3 const *s = scales + i;
+
+		//load rotations and transpose to lanes:
+		__m128 qx = _mm_loadu_ps(&rotations[i+0].x);
+		__m128 qy = _mm_loadu_ps(&rotations[i+1].x);
+		__m128 qz = _mm_loadu_ps(&rotations[i+2].x);
+		__m128 qw = _mm_loadu_ps(&rotations[i+3].x);
+		_MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+
+		__m128 px = _mm_set_ps(p[3].x, p[2].x, p[1].x, p[0].x);
+		__m128 py = _mm_set_ps(p[3].y, p[2].y, p[1].y, p[0].y);
+		__m128 pz = _mm_set_ps(p[3].z, p[2].z, p[1].z, p[0].z);
+		__m128 sx = _mm_set_ps(s[3].x, s[2].x, s[1].x, s[0].x);
+		__m128 sy = _mm_set_ps(s[3].y, s[2].y, s[1].y, s[0].y);
+		__m128 sz = _mm_set_ps(s[3].z, s[2].z, s[1].z, s[0].z);
+
+		__m128 e[12]; //output matrix entries, column-major
+
+		if (trs) {
+			__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+			__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+			__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+			e[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+			e[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+			e[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+			e[3] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+			e[4] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+			e[5] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+			e[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+			e[7] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+			e[8] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+			e[9] = px;
+			e[10] = py;
+			e[11] = pz;
+
+			//transpose back to one matrix per transform:
+			_MM_TRANSPOSE4_PS(e[0], e[1], e[2], e[3]);
+			_MM_TRANSPOSE4_PS(e[4], e[5], e[6], e[7]);
+			_MM_TRANSPOSE4_PS(e[8], e[9], e[10], e[11]);
+			for (uint32_t k = 0; k < 4; ++k) {
+				float *out = &trs[i+k][0][0];
+				_mm_storeu_ps(out + 0, e[k]);
+				_mm_storeu_ps(out + 4, e[4+k]);
+				_mm_storeu_ps(out + 8, e[8+k]);
+			}
+		}
+
+		if (inverse_trs) {
+			//inverse rotation is conjugate / dot(q,q):
+			__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw)));
+			__m128 ix = _mm_div_ps(_mm_sub_ps(zero, qx), len2);
+			__m128 iy = _mm_div_ps(_mm_sub_ps(zero, qy), len2);
+			__m128 iz = _mm_div_ps(_mm_sub_ps(zero, qz), len2);
+			__m128 iw = _mm_div_ps(qw, len2);
+
+			__m128 xx = _mm_mul_ps(ix, ix), yy = _mm_mul_ps(iy, iy), zz = _mm_mul_ps(iz, iz);
+			__m128 xy = _mm_mul_ps(ix, iy), xz = _mm_mul_ps(ix, iz), yz = _mm_mul_ps(iy, iz);
+			__m128 wx = _mm_mul_ps(iw, ix), wy = _mm_mul_ps(iw, iy), wz = _mm_mul_ps(iw, iz);
+
+			//zero scales give zero (not infinite) inverse scales:
+			__m128 isx = _mm_blendv_ps(_mm_div_ps(one, sx), zero, _mm_cmpeq_ps(sx, zero));
+			__m128 isy = _mm_blendv_ps(_mm_div_ps(one, sy), zero, _mm_cmpeq_ps(sy, zero));
+			__m128 isz = _mm_blendv_ps(_mm_div_ps(one, sz), zero, _mm_cmpeq_ps(sz, zero));
+
+			//inverse rotation, with rows scaled by inverse scale:
+			e[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), isx);
+			e[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), isy);
+			e[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), isz);
+			e[3] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), isx);
+			e[4] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), isy);
+			e[5] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), isz);
+			e[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), isx);
+			e[7] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), isy);
+			e[8] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), isz);
+
+			//translation is inv_rot * -position:
+			e[9] = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], px), _mm_mul_ps(e[3], py)), _mm_mul_ps(e[6], pz)));
+			e[10] = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[1], px), _mm_mul_ps(e[4], py)), _mm_mul_ps(e[7], pz)));
+			e[11] = _mm_sub_ps(zero, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[2], px), _mm_mul_ps(e[5], py)), _mm_mul_ps(e[8], pz)));
+
+			_MM_TRANSPOSE4_PS(e[0], e[1], e[2], e[3]);
+			_MM_TRANSPOSE4_PS(e[4], e[5], e[6], e[7]);
+			_MM_TRANSPOSE4_PS(e[8], e[9], e[10], e[11]);
+			for (uint32_t k = 0; k < 4; ++k) {
+				float *out = &inverse_trs[i+k][0][0];
+				_mm_storeu_ps(out + 0, e[k]);
+				_mm_storeu_ps(out + 4, e[4+k]);
+				_mm_storeu_ps(out + 8, e[8+k]);
+			}
+		}
+	}
+
+	//leftovers:
+	make_trs_batch_scalar(count - i, positions + i, rotations + i, scales + i,
+		trs ? trs + i : nullptr, inverse_trs ? inverse_trs + i : nullptr);
+}
+
+TARGET_AVX2 static void make_trs_batch_avx2(uint32_t count,
+	glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales,
+	glm::mat4x3 *trs, glm::mat4x3 *inverse_trs) {
+
+	__m256 const zero = _mm256_setzero_ps();
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const two = _mm256_set1_ps(2.0f);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		glm::vec3 const *p = positions + i;
+		glm::vec3 const *s = scales + i;
+
+		//load rotations and transpose to lanes (four at a time):
+		__m128 qx_lo = _mm_loadu_ps(&rotations[i+0].x);
+		__m128 qy_lo = _mm_loadu_ps(&rotations[i+1].x);
+		__m128 qz_lo = _mm_loadu_ps(&rotations[i+2].x);
+		__m128 qw_lo = _mm_loadu_ps(&rotations[i+3].x);
+		_MM_TRANSPOSE4_PS(qx_lo, qy_lo, qz_lo, qw_lo);
+		__m128 qx_hi = _mm_loadu_ps(&rotations[i+4].x);
+		__m128 qy_hi = _mm_loadu_ps(&rotations[i+5].x);
+		__m128 qz_hi = _mm_loadu_ps(&rotations[i+6].x);
+		__m128 qw_hi = _mm_loadu_ps(&rotations[i+7].x);
+		_MM_TRANSPOSE4_PS(qx_hi, qy_hi, qz_hi, qw_hi);
+		__m256 qx = _mm256_insertf128_ps(_mm256_castps128_ps256(qx_lo), qx_hi, 1);
+		__m256 qy = _mm256_insertf128_ps(_mm256_castps128_ps256(qy_lo), qy_hi, 1);
+		__m256 qz = _mm256_insertf128_ps(_mm256_castps128_ps256(qz_lo), qz_hi, 1);
+		__m256 qw = _mm256_insertf128_ps(_mm256_castps128_ps256(qw_lo), qw_hi, 1);
+
+		__m256 px = _mm256_set_ps(p[7].x, p[6].x, p[5].x, p[4].x, p[3].x, p[2].x, p[1].x, p[0].x);
+		__m256 py = _mm256_set_ps(p[7].y, p[6].y, p[5].y, p[4].y, p[3].y, p[2].y, p[1].y, p[0].y);
+		__m256 pz = _mm256_set_ps(p[7].z, p[6].z, p[5].z, p[4].z, p[3].z, p[2].z, p[1].z, p[0].z);
+		__m256 sx = _mm256_set_ps(s[7].x, s[6].x, s[5].x, s[4].x, s[3].x, s[2].x, s[1].x, s[0].x);
+		__m256 sy = _mm256_set_ps(s[7].y, s[6].y, s[5].y, s[4].y, s[3].y, s[2].y, s[1].y, s[0].y);
+		__m256 sz = _mm256_set_ps(s[7].z, s[6].z, s[5].z, s[4].z, s[3].z, s[2].z, s[1].z, s[0].z);
+
+		__m256 e[12]; //output matrix entries, column-major
+
+		//transpose back to one matrix per transform and store:
+		#define STORE_TRANSPOSED(OUT) \
+			for (uint32_t half = 0; half < 2; ++half) { \
+				__m128 b[12]; \
+				for (uint32_t j = 0; j < 12; ++j) { \
+					b[j] = (half == 0 ? _mm256_castps256_ps128(e[j]) : _mm256_extractf128_ps(e[j], 1)); \
+				} \
+				_MM_TRANSPOSE4_PS(b[0], b[1], b[2], b[3]); \
+				_MM_TRANSPOSE4_PS(b[4], b[5], b[6], b[7]); \
+				_MM_TRANSPOSE4_PS(b[8], b[9], b[10], b[11]); \
+				for (uint32_t k = 0; k < 4; ++k) { \
+					float *out = &(OUT)[i + 4 * half + k][0][0]; \
+					_mm_storeu_ps(out + 0, b[k]); \
+					_mm_storeu_ps(out + 4, b[4+k]); \
+					_mm_storeu_ps(out + 8, b[8+k]); \
+				} \
+			}
+
+		if (trs) {
+			__m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+			__m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+			__m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+
+			e[0] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), sx);
+			e[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+			e[2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+			e[3] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+			e[4] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), sy);
+			e[5] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+			e[6] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+			e[7] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+			e[8] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), sz);
+			e[9] = px;
+			e[10] = py;
+			e[11] = pz;
+
+			STORE_TRANSPOSED(trs)
+		}
+
+		if (inverse_trs) {
+			//inverse rotation is conjugate / dot(q,q):
+			__m256 len2 = _mm256_fmadd_ps(qx, qx, _mm256_fmadd_ps(qy, qy, _mm256_fmadd_ps(qz, qz, _mm256_mul_ps(qw, qw))));
+			__m256 ix = _mm256_div_ps(_mm256_sub_ps(zero, qx), len2);
+			__m256 iy = _mm256_div_ps(_mm256_sub_ps(zero, qy), len2);
+			__m256 iz = _mm256_div_ps(_mm256_sub_ps(zero, qz), len2);
+			__m256 iw = _mm256_div_ps(qw, len2);
+
+			__m256 xx = _mm256_mul_ps(ix, ix), yy = _mm256_mul_ps(iy, iy), zz = _mm256_mul_ps(iz, iz);
+			__m256 xy = _mm256_mul_ps(ix, iy), xz = _mm256_mul_ps(ix, iz), yz = _mm256_mul_ps(iy, iz);
+			__m256 wx = _mm256_mul_ps(iw, ix), wy = _mm256_mul_ps(iw, iy), wz = _mm256_mul_ps(iw, iz);
+
+			//zero scales give zero (not infinite) inverse scales:
+			__m256 isx = _mm256_blendv_ps(_mm256_div_ps(one, sx), zero, _mm256_cmp_ps(sx, zero, _CMP_EQ_OQ));
+			__m256 isy = _mm256_blendv_ps(_mm256_div_ps(one, sy), zero, _mm256_cmp_ps(sy, zero, _CMP_EQ_OQ));
+			__m256 isz = _mm256_blendv_ps(_mm256_div_ps(one, sz), zero, _mm256_cmp_ps(sz, zero, _CMP_EQ_OQ));
+
+			//inverse rotation, with rows scaled by inverse scale:
+			e[0] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), isx);
+			e[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), isy);
+			e[2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), isz);
+			e[3] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), isx);
+			e[4] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), isy);
+			e[5] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), isz);
+			e[6] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), isx);
+			e[7] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), isy);
+			e[8] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), isz);
+
+			//translation is inv_rot * -position:
+			e[9] = _mm256_sub_ps(zero, _mm256_fmadd_ps(e[0], px, _mm256_fmadd_ps(e[3], py, _mm256_mul_ps(e[6], pz))));
+			e[10] = _mm256_sub_ps(zero, _mm256_fmadd_ps(e[1], px, _mm256_fmadd_ps(e[4], py, _mm256_mul_ps(e[7], pz))));
+			e[11] = _mm256_sub_ps(zero, _mm256_fmadd_ps(e[2], px, _mm256_fmadd_ps(e[5], py, _mm256_mul_ps(e[8], pz))));
+
+			STORE_TRANSPOSED(inverse_trs)
+		}
+
+		#undef STORE_TRANSPOSED
+	}
+
+	//leftovers:
+	make_trs_batch_scalar(count - i, positions + i, rotations + i, scales + i,
+		trs ? trs + i : nullptr, inverse_trs ? inverse_trs + i : nullptr);
+}
+
+static bool cpu_has_sse41() {
+	#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 19)) != 0;
+	#else
+	return __builtin_cpu_supports("sse4.1");
+	#endif
+}
+
+static bool cpu_has_avx2_fma() {
+	#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	if (!osxsave || !fma) return false;
+	if ((_xgetbv(0) & 0x6) != 0x6) return false; //OS must save ymm registers
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+	#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	#endif
+}
+
+#endif //TRS_X86
+
+std::vector< TRSBatchKernel > const &get_trs_batch_kernels() {
+	static std::vector< TRSBatchKernel > kernels = [](){
+		std::vector< TRSBatchKernel > ret;
+		ret.push_back(TRSBatchKernel{"scalar", make_trs_batch_scalar});
+		#ifdef TRS_X86
+		if (cpu_has_sse41()) ret.push_back(TRSBatchKernel{"sse4.1", make_trs_batch_sse41});
+		if (cpu_has_avx2_fma()) ret.push_back(TRSBatchKernel{"avx2", make_trs_batch_avx2});
+		#endif
+		return ret;
+	}();
+	return kernels;
+}
+
+void make_trs_batch(uint32_t count,
+	glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales,
+	glm::mat4x3 *trs, glm::mat4x3 *inverse_trs) {
+	static TRSBatchFn fn = get_trs_batch_kernels().back().fn;
+	fn(count, positions, rotations, scales, trs, inverse_trs);
+}
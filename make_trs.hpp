@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * Helpers that build translate * rotate * scale matrices (and their inverses),
+ *  as used by Scene::Transform::make_local_to_parent / make_parent_to_local.
+ *
+ * The *_batch functions convert whole arrays at once; on x86 they use SSE4.1 or
+ *  AVX2 code (chosen at runtime based on CPUID) and fall back to scalar code elsewhere.
+ *
+ */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+//single-transform versions (these are also the reference for the batched versions):
+glm::mat4x3 make_trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale);
+glm::mat4x3 make_inverse_trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale);
+
+//batched versions:
+// for i in [0,count), sets trs[i] = make_trs(...) and inverse_trs[i] = make_inverse_trs(...)
+// (either output array may be null if it is not needed)
+typedef void (*TRSBatchFn)(uint32_t count,
+	glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales,
+	glm::mat4x3 *trs, glm::mat4x3 *inverse_trs);
+
+//uses the fastest kernel supported by this CPU:
+void make_trs_batch(uint32_t count,
+	glm::vec3 const *positions, glm::quat const *rotations, glm::vec3 const *scales,
+	glm::mat4x3 *trs, glm::mat4x3 *inverse_trs);
+
+//all kernels supported by this CPU, slowest ("scalar") first:
+// (useful for checking kernels against each other)
+struct TRSBatchKernel {
+	char const *name;
+	TRSBatchFn fn;
+};
+std::vector< TRSBatchKernel > const &get_trs_batch_kernels();
@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file read-only into memory, so that its contents
+ *  can be used in place (see view_chunk() in read_write_chunk.hpp) instead of
+ *  being copied into temporary buffers by a stream.
+ *
+ * The mapping lasts as long as the MappedFile object.
+ *
+ */
+
+#include <string>
+#include <cstddef>
+
+struct MappedFile {
+	//map a file:
+	// note: will throw if the file can't be opened or mapped.
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	//file contents (nullptr for empty files):
+	char const *data = nullptr;
+	size_t size = 0;
+
+	char const *begin() const { return data; }
+	char const *end() const { return data + size; }
+
+	//mappings are owned, so copying is not allowed:
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	//-- internals --
+	#if defined(_WIN32)
+	void *mapping = nullptr; //(HANDLE)
+	#endif
+};
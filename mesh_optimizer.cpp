@@ -0,0 +1,550 @@
+#include "mesh_optimizer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	//FIFO post-transform cache: a vertex is cached if it was added within the last 'cache_size' misses:
+	struct FifoCache {
+		FifoCache(uint32_t vertex_count, uint32_t cache_size_) : cache_size(cache_size_), added(vertex_count, 0), time(cache_size_ + 1) { }
+		uint32_t cache_size;
+		std::vector< uint32_t > added; //time at which each vertex was last added
+		uint32_t time;
+
+		//returns 1 if 'v' had to be transformed:
+		uint32_t use(uint32_t v) {
+			if (time - added[v] <= cache_size) return 0;
+			added[v] = time++;
+			return 1;
+		}
+		uint32_t use(uint32_t const *triangle) {
+			return use(triangle[0]) + use(triangle[1]) + use(triangle[2]);
+		}
+		//forget everything:
+		void reset() {
+			time += cache_size + 1;
+		}
+	};
+}
+
+VertexCacheStats analyze_vertex_cache(uint32_t const *indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+	VertexCacheStats stats;
+	if (index_count < 3) return stats;
+
+	FifoCache cache(vertex_count, cache_size);
+	std::vector< uint8_t > used(vertex_count, 0);
+	uint32_t misses = 0;
+	uint32_t unique = 0;
+	for (uint32_t i = 0; i < index_count; ++i) {
+		assert(indices[i] < vertex_count);
+		misses += cache.use(indices[i]);
+		if (!used[indices[i]]) {
+			used[indices[i]] = 1;
+			unique += 1;
+		}
+	}
+	stats.acmr = float(misses) / float(index_count / 3);
+	stats.atvr = float(misses) / float(unique);
+	return stats;
+}
+
+void optimize_vertex_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+	uint32_t triangle_count = index_count / 3;
+	if (triangle_count < 2) return;
+
+	//triangles using each vertex ('live' counts the ones not yet emitted):
+	std::vector< uint32_t > live(vertex_count, 0);
+	for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+		assert(indices[i] < vertex_count);
+		live[indices[i]] += 1;
+	}
+	std::vector< uint32_t > offsets(vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		offsets[v+1] = offsets[v] + live[v];
+	}
+	std::vector< uint32_t > adjacency(triangle_count * 3);
+	{
+		std::vector< uint32_t > fill(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector< uint32_t > cache_time(vertex_count, 0);
+	uint32_t time = cache_size + 1;
+	std::vector< uint8_t > emitted(triangle_count, 0);
+	std::vector< uint32_t > dead_ends; //recently-used vertices, to look for a new fanning vertex in when stuck
+	std::vector< uint32_t > candidates;
+	std::vector< uint32_t > output;
+	output.reserve(triangle_count * 3);
+	uint32_t cursor = 0; //vertices before this one have no live triangles
+
+	//Tipsify: emit all of the fanning vertex's remaining triangles, then move to a nearby vertex:
+	uint32_t fan = 0;
+	while (fan != -1U) {
+		candidates.clear();
+		for (uint32_t a = offsets[fan]; a < offsets[fan+1]; ++a) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = 1;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t v = indices[3*t+k];
+				output.emplace_back(v);
+				dead_ends.emplace_back(v);
+				candidates.emplace_back(v);
+				live[v] -= 1;
+				if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+			}
+		}
+
+		//the next fanning vertex is the candidate that has been in the cache longest and will still be there after emitting its triangles:
+		// (or, if none will be, any candidate with triangles left)
+		uint32_t next = -1U;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) continue;
+			int64_t priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+
+		//dead end: back up through recently used vertices, then scan for any vertex with triangles left:
+		while (next == -1U && !dead_ends.empty()) {
+			uint32_t v = dead_ends.back();
+			dead_ends.pop_back();
+			if (live[v] > 0) next = v;
+		}
+		while (next == -1U && cursor < vertex_count) {
+			if (live[cursor] > 0) next = cursor;
+			++cursor;
+		}
+
+		fan = next;
+	}
+
+	assert(output.size() == triangle_count * 3);
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimize_overdraw(uint32_t *indices, uint32_t index_count, MeshBuffer::Vertex const *vertices, uint32_t vertex_count, float threshold, uint32_t cache_size) {
+	uint32_t triangle_count = index_count / 3;
+	if (triangle_count < 2) return;
+
+	FifoCache cache(vertex_count, cache_size);
+
+	//hard boundaries: triangles whose vertices all miss usually start a new patch of the mesh:
+	std::vector< uint32_t > patches;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		if (cache.use(indices + 3*t) == 3 || t == 0) patches.emplace_back(t);
+	}
+	patches.emplace_back(triangle_count);
+
+	//soft boundaries: split patches into clusters wherever the ACMR so far is within 'threshold' of the patch's,
+	// so that drawing clusters in any order costs at most that much in cache efficiency:
+	std::vector< uint32_t > clusters;
+	for (uint32_t p = 0; p + 1 < patches.size(); ++p) {
+		uint32_t begin = patches[p];
+		uint32_t end = patches[p+1];
+
+		cache.reset();
+		uint32_t patch_misses = 0;
+		for (uint32_t t = begin; t < end; ++t) {
+			patch_misses += cache.use(indices + 3*t);
+		}
+		float limit = threshold * float(patch_misses) / float(end - begin);
+
+		cache.reset();
+		clusters.emplace_back(begin);
+		uint32_t cluster_begin = begin;
+		uint32_t cluster_misses = 0;
+		for (uint32_t t = begin; t < end; ++t) {
+			cluster_misses += cache.use(indices + 3*t);
+			if (t + 1 < end && float(cluster_misses) <= limit * float(t + 1 - cluster_begin)) {
+				clusters.emplace_back(t + 1);
+				cluster_begin = t + 1;
+				cluster_misses = 0;
+				cache.reset();
+			}
+		}
+	}
+	clusters.emplace_back(triangle_count);
+
+	//area-weighted centroid and normal of each cluster (and centroid of the whole mesh):
+	struct Cluster {
+		uint32_t begin, end;
+		glm::vec3 centroid = glm::vec3(0.0f);
+		glm::vec3 normal = glm::vec3(0.0f);
+		float area = 0.0f;
+		float sort_key = 0.0f;
+	};
+	std::vector< Cluster > order;
+	order.reserve(clusters.size() - 1);
+	glm::vec3 mesh_centroid = glm::vec3(0.0f);
+	float mesh_area = 0.0f;
+	for (uint32_t c = 0; c + 1 < clusters.size(); ++c) {
+		order.emplace_back();
+		Cluster &cluster = order.back();
+		cluster.begin = clusters[c];
+		cluster.end = clusters[c+1];
+		for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+			glm::vec3 const &a = vertices[indices[3*t+0]].Position;
+			glm::vec3 const &b = vertices[indices[3*t+1]].Position;
+			glm::vec3 const &d = vertices[indices[3*t+2]].Position;
+			glm::vec3 cross = glm::cross(b - a, d - a);
+			float area = glm::length(cross);
+			cluster.centroid += (a + b + d) * (area / 3.0f);
+			cluster.normal += cross;
+			cluster.area += area;
+		}
+		mesh_centroid += cluster.centroid;
+		mesh_area += cluster.area;
+		if (cluster.area > 0.0f) cluster.centroid /= cluster.area;
+	}
+	if (mesh_area <= 0.0f) return; //(no idea which way anything faces)
+	mesh_centroid /= mesh_area;
+
+	//clusters facing away from the center of the mesh tend to occlude the rest, so draw them first:
+	for (auto &cluster : order) {
+		float length = glm::length(cluster.normal);
+		cluster.sort_key = (length > 0.0f ? glm::dot(cluster.centroid - mesh_centroid, cluster.normal / length) : 0.0f);
+	}
+	std::stable_sort(order.begin(), order.end(), [](Cluster const &a, Cluster const &b) {
+		return a.sort_key > b.sort_key;
+	});
+
+	std::vector< uint32_t > output;
+	output.reserve(triangle_count * 3);
+	for (auto const &cluster : order) {
+		output.insert(output.end(), indices + 3*cluster.begin, indices + 3*cluster.end);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimize_vertex_fetch(uint32_t *indices, uint32_t index_count, MeshBuffer::Vertex *vertices, uint32_t vertex_count) {
+	//number vertices in order of first use (any unused ones go at the end):
+	std::vector< uint32_t > remap(vertex_count, -1U);
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < index_count; ++i) {
+		assert(indices[i] < vertex_count);
+		uint32_t &to = remap[indices[i]];
+		if (to == -1U) to = next++;
+		indices[i] = to;
+	}
+	for (auto &to : remap) {
+		if (to == -1U) to = next++;
+	}
+
+	std::vector< MeshBuffer::Vertex > reordered(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		reordered[remap[v]] = vertices[v];
+	}
+	std::copy(reordered.begin(), reordered.end(), vertices);
+}
+
+void optimize_meshes(MeshBuffer *buffer_, std::ostream *report) {
+	assert(buffer_);
+	MeshBuffer &buffer = *buffer_;
+	if (buffer.vertices.empty() && !buffer.meshes.empty()) throw std::runtime_error("optimize_meshes() needs a CPU copy of the vertices (see MeshBuffer::MeshBuffer's 'keep_vertices')");
+
+	//index ranges that use each vertex range:
+	// (vertices can only be renumbered for one index range at a time, so shared vertices are left in place)
+	std::map< std::pair< GLuint, GLuint >, std::set< std::pair< GLuint, GLuint > > > users;
+	for (auto const &nm : buffer.meshes) {
+		Mesh const &mesh = nm.second;
+		if (mesh.index_type == 0) continue;
+		users[std::make_pair(mesh.vertex_start, mesh.vertex_count)].emplace(mesh.start, mesh.count);
+	}
+
+	auto fixed = [](float value) {
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+		return std::string(buffer);
+	};
+
+	std::set< std::pair< GLuint, GLuint > > done; //index ranges already optimized
+	for (auto const &nm : buffer.meshes) {
+		Mesh const &mesh = nm.second;
+		if (mesh.type != GL_TRIANGLES || mesh.index_type == 0) continue;
+		if (!done.emplace(mesh.start, mesh.count).second) continue;
+
+		uint32_t *indices = buffer.indices.data() + mesh.start;
+		uint32_t count = mesh.count / 3 * 3;
+		MeshBuffer::Vertex *vertices = buffer.vertices.data() + mesh.vertex_start;
+
+		VertexCacheStats before = analyze_vertex_cache(indices, count, mesh.vertex_count);
+		if (mesh.cluster_count != 0) {
+			//(triangles can't move between clusters, and clusters' order was already picked for overdraw)
+			for (uint32_t c = mesh.cluster_start; c < mesh.cluster_start + mesh.cluster_count; ++c) {
+				MeshCluster const &cluster = buffer.clusters[c];
+				optimize_vertex_cache(buffer.indices.data() + cluster.index_begin, cluster.index_end - cluster.index_begin, mesh.vertex_count);
+			}
+		} else {
+			optimize_vertex_cache(indices, count, mesh.vertex_count);
+			optimize_overdraw(indices, count, vertices, mesh.vertex_count);
+		}
+		if (users[std::make_pair(mesh.vertex_start, mesh.vertex_count)].size() == 1) {
+			optimize_vertex_fetch(indices, count, vertices, mesh.vertex_count);
+		}
+		VertexCacheStats after = analyze_vertex_cache(indices, count, mesh.vertex_count);
+
+		if (report) {
+			*report << "  '" << nm.first << "': " << (count / 3) << " triangles, " << mesh.vertex_count << " vertices;"
+				<< " ACMR " << fixed(before.acmr) << " -> " << fixed(after.acmr) << ","
+				<< " ATVR " << fixed(before.atvr) << " -> " << fixed(after.atvr) << "\n";
+		}
+	}
+	if (report) report->flush();
+}
+
+void compute_cluster_bounds(MeshCluster *cluster_, uint32_t const *indices, MeshBuffer::Vertex const *vertices) {
+	assert(cluster_);
+	MeshCluster &cluster = *cluster_;
+
+	cluster.min = glm::vec3( std::numeric_limits< float >::infinity());
+	cluster.max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (uint32_t i = cluster.index_begin; i < cluster.index_end; ++i) {
+		cluster.min = glm::min(cluster.min, vertices[indices[i]].Position);
+		cluster.max = glm::max(cluster.max, vertices[indices[i]].Position);
+	}
+	glm::vec3 center = 0.5f * (cluster.min + cluster.max);
+
+	//cone axis is the average of the (non-degenerate) triangles' normals:
+	glm::vec3 axis = glm::vec3(0.0f);
+	for (uint32_t i = cluster.index_begin; i + 2 < cluster.index_end; i += 3) {
+		glm::vec3 const &a = vertices[indices[i+0]].Position;
+		glm::vec3 const &b = vertices[indices[i+1]].Position;
+		glm::vec3 const &c = vertices[indices[i+2]].Position;
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float length = glm::length(normal);
+		if (length > 0.0f) axis += normal / length;
+	}
+	cluster.cone_apex = center;
+	cluster.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	cluster.cone_cutoff = 2.0f; //(never culled)
+	cluster.padding_ = 0.0f;
+	float axis_length = glm::length(axis);
+	if (!(axis_length > 0.0f)) return;
+	axis /= axis_length;
+
+	//the cone must contain every triangle's normal; if it's too wide, the cluster is never entirely back-facing:
+	float min_dot = 1.0f;
+	for (uint32_t i = cluster.index_begin; i + 2 < cluster.index_end; i += 3) {
+		glm::vec3 const &a = vertices[indices[i+0]].Position;
+		glm::vec3 const &b = vertices[indices[i+1]].Position;
+		glm::vec3 const &c = vertices[indices[i+2]].Position;
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float length = glm::length(normal);
+		if (length > 0.0f) min_dot = std::min(min_dot, glm::dot(axis, normal / length));
+	}
+	if (min_dot <= 0.1f) return;
+
+	//the apex is moved back along the axis until it is behind every triangle's plane,
+	// so that a viewer who sees the apex as back-facing (within the cone) sees all triangles that way:
+	// (Zeux's meshoptimizer does the same)
+	float max_t = 0.0f;
+	for (uint32_t i = cluster.index_begin; i + 2 < cluster.index_end; i += 3) {
+		glm::vec3 const &a = vertices[indices[i+0]].Position;
+		glm::vec3 const &b = vertices[indices[i+1]].Position;
+		glm::vec3 const &c = vertices[indices[i+2]].Position;
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float length = glm::length(normal);
+		if (!(length > 0.0f)) continue;
+		normal /= length;
+		float t = glm::dot(center - a, normal) / glm::dot(axis, normal); //(how far back the apex must be to be behind this plane)
+		max_t = std::max(max_t, t);
+	}
+	cluster.cone_apex = center - axis * max_t;
+	cluster.cone_axis = axis;
+	cluster.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+void build_clusters(MeshBuffer *buffer_, uint32_t max_triangles, std::ostream *report) {
+	assert(buffer_);
+	MeshBuffer &buffer = *buffer_;
+	assert(max_triangles > 0);
+	if (buffer.vertices.empty() && !buffer.meshes.empty()) throw std::runtime_error("build_clusters() needs a CPU copy of the vertices (see MeshBuffer::MeshBuffer's 'keep_vertices')");
+
+	buffer.clusters.clear();
+	for (auto &nm : buffer.meshes) {
+		nm.second.cluster_start = nm.second.cluster_count = 0;
+	}
+
+	std::map< std::pair< GLuint, GLuint >, std::pair< GLuint, GLuint > > done; //index range -> cluster range (for meshes sharing indices)
+	for (auto &nm : buffer.meshes) {
+		Mesh &mesh = nm.second;
+		if (mesh.type != GL_TRIANGLES || mesh.index_type == 0) continue;
+		uint32_t triangle_count = mesh.count / 3;
+		if (triangle_count <= max_triangles || mesh.count % 3 != 0) continue; //(small enough to cull as a whole)
+
+		auto f = done.find(std::make_pair(mesh.start, mesh.count));
+		if (f != done.end()) {
+			mesh.cluster_start = f->second.first;
+			mesh.cluster_count = f->second.second;
+			continue;
+		}
+
+		uint32_t *indices = buffer.indices.data() + mesh.start;
+		MeshBuffer::Vertex const *vertices = buffer.vertices.data() + mesh.vertex_start;
+
+		//triangles are neighbors if they share a position -- not just a vertex -- since vertices on
+		// creases and seams are split by their normals and texture coordinates:
+		std::vector< uint32_t > position_of(mesh.vertex_count); //vertex -> position id
+		uint32_t position_count = 0;
+		{
+			std::map< std::array< float, 3 >, uint32_t > ids;
+			for (uint32_t v = 0; v < mesh.vertex_count; ++v) {
+				glm::vec3 const &p = vertices[v].Position;
+				auto ret = ids.emplace(std::array< float, 3 >{{p.x, p.y, p.z}}, position_count);
+				if (ret.second) position_count += 1;
+				position_of[v] = ret.first->second;
+			}
+		}
+
+		//triangles using each position:
+		std::vector< uint32_t > offsets(position_count + 1, 0);
+		for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+			offsets[position_of[indices[i]] + 1] += 1;
+		}
+		for (uint32_t p = 0; p < position_count; ++p) {
+			offsets[p+1] += offsets[p];
+		}
+		std::vector< uint32_t > adjacency(triangle_count * 3);
+		{
+			std::vector< uint32_t > fill(offsets.begin(), offsets.end() - 1);
+			for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+				adjacency[fill[position_of[indices[i]]]++] = i / 3;
+			}
+		}
+
+		std::vector< glm::vec3 > normals(triangle_count);
+		std::vector< glm::vec3 > centroids(triangle_count);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			glm::vec3 const &a = vertices[indices[3*t+0]].Position;
+			glm::vec3 const &b = vertices[indices[3*t+1]].Position;
+			glm::vec3 const &c = vertices[indices[3*t+2]].Position;
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			normals[t] = (length > 0.0f ? normal / length : glm::vec3(0.0f));
+			centroids[t] = (a + b + c) / 3.0f;
+		}
+
+		//grow each cluster from the first unassigned triangle (in the current, cache-friendly, order),
+		// adding the neighboring triangle that needs the fewest new vertices and best matches the cluster's
+		// normal and position -- so clusters are compact and have narrow normal cones:
+		std::vector< uint32_t > cluster_of(triangle_count, -1U);
+		std::vector< uint32_t > vertex_cluster(mesh.vertex_count, -1U); //cluster that last used each vertex
+		std::vector< uint32_t > order; //triangles, cluster by cluster
+		std::vector< uint32_t > cluster_ends; //end of each cluster in 'order'
+		order.reserve(triangle_count);
+		std::vector< uint32_t > candidates;
+		uint32_t seed = 0;
+		while (true) {
+			while (seed < triangle_count && cluster_of[seed] != -1U) ++seed;
+			if (seed == triangle_count) break;
+
+			uint32_t cluster = uint32_t(cluster_ends.size());
+			uint32_t begin = uint32_t(order.size());
+			glm::vec3 normal_sum = glm::vec3(0.0f);
+			glm::vec3 centroid_sum = glm::vec3(0.0f);
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+			candidates.clear();
+
+			uint32_t next = seed;
+			while (next != -1U) {
+				cluster_of[next] = cluster;
+				order.emplace_back(next);
+				normal_sum += normals[next];
+				centroid_sum += centroids[next];
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t v = indices[3*next+k];
+					vertex_cluster[v] = cluster;
+					min = glm::min(min, vertices[v].Position);
+					max = glm::max(max, vertices[v].Position);
+					uint32_t p = position_of[v];
+					for (uint32_t a = offsets[p]; a < offsets[p+1]; ++a) {
+						if (cluster_of[adjacency[a]] == -1U) candidates.emplace_back(adjacency[a]);
+					}
+				}
+				if (order.size() - begin >= max_triangles) break;
+
+				uint32_t size = uint32_t(order.size() - begin);
+				glm::vec3 axis = normal_sum;
+				float axis_length = glm::length(axis);
+				if (axis_length > 0.0f) axis /= axis_length;
+				glm::vec3 center = centroid_sum / float(size);
+				float radius = std::max(0.5f * glm::length(max - min), 1e-6f);
+
+				next = -1U;
+				float best = std::numeric_limits< float >::infinity();
+				uint32_t kept = 0;
+				for (uint32_t t : candidates) {
+					if (cluster_of[t] != -1U) continue; //(taken since it was found)
+					candidates[kept++] = t;
+					uint32_t added = 0;
+					for (uint32_t k = 0; k < 3; ++k) {
+						if (vertex_cluster[indices[3*t+k]] != cluster) added += 1;
+					}
+					float score = float(added)
+						+ 0.5f * (1.0f - glm::dot(axis, normals[t]))
+						+ 0.25f * glm::length(centroids[t] - center) / radius;
+					if (score < best) {
+						best = score;
+						next = t;
+					}
+				}
+				candidates.resize(kept);
+			}
+			cluster_ends.emplace_back(uint32_t(order.size()));
+		}
+		assert(order.size() == triangle_count);
+
+		//write triangles cluster by cluster, keeping their relative order within each cluster:
+		std::vector< uint32_t > reordered;
+		reordered.reserve(triangle_count * 3);
+		mesh.cluster_start = GLuint(buffer.clusters.size());
+		uint32_t begin = 0;
+		for (uint32_t end : cluster_ends) {
+			std::sort(order.begin() + begin, order.begin() + end);
+			buffer.clusters.emplace_back();
+			MeshCluster &cluster = buffer.clusters.back();
+			cluster.index_begin = mesh.start + uint32_t(reordered.size());
+			for (uint32_t i = begin; i < end; ++i) {
+				reordered.insert(reordered.end(), indices + 3*order[i], indices + 3*order[i] + 3);
+			}
+			cluster.index_end = mesh.start + uint32_t(reordered.size());
+			begin = end;
+		}
+		std::copy(reordered.begin(), reordered.end(), indices);
+		mesh.cluster_count = GLuint(buffer.clusters.size()) - mesh.cluster_start;
+
+		for (uint32_t c = mesh.cluster_start; c < mesh.cluster_start + mesh.cluster_count; ++c) {
+			compute_cluster_bounds(&buffer.clusters[c], buffer.indices.data(), vertices);
+		}
+		done.emplace(std::make_pair(mesh.start, mesh.count), std::make_pair(mesh.cluster_start, mesh.cluster_count));
+
+		if (report) {
+			uint32_t cones = 0;
+			for (uint32_t c = mesh.cluster_start; c < mesh.cluster_start + mesh.cluster_count; ++c) {
+				if (buffer.clusters[c].cone_cutoff <= 1.0f) cones += 1;
+			}
+			*report << "  '" << nm.first << "': " << triangle_count << " triangles in " << mesh.cluster_count << " clusters ("
+				<< cones << " with normal cones)\n";
+		}
+	}
+	if (report) report->flush();
+}
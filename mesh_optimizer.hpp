@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * Mesh optimization for indexed triangle meshes (see Mesh.hpp), in three passes:
+ *  1. optimize_vertex_cache() reorders triangles so that vertices are re-used
+ *     while still in the post-transform cache (Tipsify; Sander et al., 2007);
+ *  2. optimize_overdraw() then reorders clusters of those triangles so that
+ *     outward-facing ones come first, as long as this doesn't cost more than a
+ *     little cache efficiency (also from Sander et al.);
+ *  3. optimize_vertex_fetch() finally renumbers vertices in order of first use,
+ *     so that vertex fetches walk through memory.
+ *
+ * optimize_meshes() runs all three on every indexed mesh in a MeshBuffer; run
+ *  it before upload() (e.g., on a worker thread at load time), or offline with
+ *  the optimize-meshes tool.
+ *
+ * build_clusters() then splits large meshes into clusters of nearby triangles
+ *  (MeshCluster) with bounds and normal cones, so that Scene can cull parts of
+ *  a mesh that are out of view or hidden behind occluders.
+ *
+ */
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <iostream>
+
+//post-transform vertex cache efficiency, from simulating a FIFO cache:
+struct VertexCacheStats {
+	float acmr = 0.0f; //average cache miss ratio: vertices transformed per triangle (0.5 is ideal for big grids, 3.0 is worst)
+	float atvr = 0.0f; //average transform to vertex ratio: vertices transformed per vertex used (1.0 is ideal)
+};
+VertexCacheStats analyze_vertex_cache(uint32_t const *indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size = 16);
+
+//the passes (each works on 'index_count' indices -- a multiple of three -- referring to 'vertex_count' vertices):
+void optimize_vertex_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size = 16);
+// 'threshold' is how much worse (as a ratio) a cluster's ACMR may get so that it can be split off and drawn in a better order:
+void optimize_overdraw(uint32_t *indices, uint32_t index_count, MeshBuffer::Vertex const *vertices, uint32_t vertex_count, float threshold = 1.05f, uint32_t cache_size = 16);
+void optimize_vertex_fetch(uint32_t *indices, uint32_t index_count, MeshBuffer::Vertex *vertices, uint32_t vertex_count);
+
+//run all three passes on each indexed GL_TRIANGLES mesh in 'buffer' (no OpenGL calls):
+// if 'report' is given, writes ACMR/ATVR before and after for each mesh to it
+// (meshes with clusters only have triangles reordered within each cluster, so the clusters stay valid)
+void optimize_meshes(MeshBuffer *buffer, std::ostream *report = nullptr);
+
+//split each indexed GL_TRIANGLES mesh with more than 'max_triangles' triangles into clusters of at most that many,
+// grown from the mesh's current triangle order (so run after optimize_meshes()); replaces any existing clusters:
+// (no OpenGL calls; the mesh's indices are reordered so that each cluster is a contiguous range)
+void build_clusters(MeshBuffer *buffer, uint32_t max_triangles = 128, std::ostream *report = nullptr);
+
+//bounds and normal cone of the triangles in indices[cluster.index_begin, cluster.index_end) (sets all but the index range):
+// ('vertices' is the mesh's first vertex, since indices are relative to it)
+void compute_cluster_bounds(MeshCluster *cluster, uint32_t const *indices, MeshBuffer::Vertex const *vertices);
@@ -0,0 +1,228 @@
+#include "occlusion_buffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width_, uint32_t height_) : width((std::max(width_, 1U) + 3U) & ~3U), height(std::max(height_, 1U)) {
+	clear();
+}
+
+void OcclusionBuffer::clear() {
+	depth.assign(width * height, 0.0f);
+}
+
+void OcclusionBuffer::add_occluder(glm::mat4 const &object_to_clip, glm::vec3 const *positions, uint32_t count) {
+	auto to_screen = [this](glm::vec4 const &clip) {
+		ScreenVertex ret;
+		ret.inv_w = 1.0f / clip.w;
+		ret.x = (clip.x * ret.inv_w * 0.5f + 0.5f) * float(width);
+		ret.y = (clip.y * ret.inv_w * 0.5f + 0.5f) * float(height);
+		return ret;
+	};
+
+	//find edges shared by two of the triangles (i.e., inside the occluder, not on its outline):
+	// (edges are matched by the bits of their endpoints, in either order, by sorting)
+	uint32_t triangles = count / 3;
+	shared_edges.clear();
+	for (uint32_t t = 0; t < triangles; ++t) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			EdgeKey key;
+			std::memcpy(key.bits + 0, &positions[3*t + i], sizeof(glm::vec3));
+			std::memcpy(key.bits + 3, &positions[3*t + (i + 1) % 3], sizeof(glm::vec3));
+			if (std::lexicographical_compare(key.bits + 3, key.bits + 6, key.bits + 0, key.bits + 3)) {
+				std::swap_ranges(key.bits + 0, key.bits + 3, key.bits + 3);
+			}
+			key.edge = 3*t + i;
+			shared_edges.emplace_back(key);
+		}
+	}
+	std::sort(shared_edges.begin(), shared_edges.end(), [](EdgeKey const &a, EdgeKey const &b) {
+		return std::lexicographical_compare(a.bits, a.bits + 6, b.bits, b.bits + 6);
+	});
+	interior_edges.assign(triangles, 0);
+	for (uint32_t i = 0; i + 1 < shared_edges.size(); ++i) {
+		if (std::equal(shared_edges[i].bits, shared_edges[i].bits + 6, shared_edges[i+1].bits)) {
+			interior_edges[shared_edges[i].edge / 3] |= 1 << (shared_edges[i].edge % 3);
+			interior_edges[shared_edges[i+1].edge / 3] |= 1 << (shared_edges[i+1].edge % 3);
+		}
+	}
+
+	for (uint32_t t = 0; t + 2 < count; t += 3) {
+		glm::vec4 clip[3] = {
+			object_to_clip * glm::vec4(positions[t+0], 1.0f),
+			object_to_clip * glm::vec4(positions[t+1], 1.0f),
+			object_to_clip * glm::vec4(positions[t+2], 1.0f),
+		};
+
+		//clip against the near plane (z >= -w), which leaves a triangle or a quad:
+		// (interior[i] is set if the polygon's edge from corner i to the next is inside the occluder; the edge along the near plane isn't)
+		glm::vec4 polygon[4];
+		bool interior[4];
+		uint32_t corners = 0;
+		for (uint32_t i = 0; i < 3; ++i) {
+			glm::vec4 const &a = clip[i];
+			glm::vec4 const &b = clip[(i + 1) % 3];
+			bool edge_interior = (interior_edges[t / 3] & (1 << i)) != 0;
+			float da = a.z + a.w;
+			float db = b.z + b.w;
+			if (da >= 0.0f) {
+				polygon[corners] = a;
+				interior[corners++] = edge_interior;
+			}
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				polygon[corners] = a + (b - a) * (da / (da - db));
+				interior[corners++] = (da < 0.0f && edge_interior);
+			}
+		}
+		if (corners < 3) continue;
+
+		//(a quad is split into two triangles, which share the diagonal)
+		ScreenVertex first = to_screen(polygon[0]);
+		ScreenVertex prev = to_screen(polygon[1]);
+		for (uint32_t i = 2; i < corners; ++i) {
+			ScreenVertex next = to_screen(polygon[i]);
+			uint32_t mask =
+				  (i == 2 && interior[0] ? 1 : 0) | (i != 2 ? 1 : 0)
+				| (interior[i-1] ? 2 : 0)
+				| (i + 1 == corners && interior[i] ? 4 : 0) | (i + 1 != corners ? 4 : 0);
+			rasterize(first, prev, next, mask);
+			prev = next;
+		}
+	}
+}
+
+void OcclusionBuffer::rasterize(ScreenVertex const &v0, ScreenVertex const &v1_, ScreenVertex const &v2_, uint32_t interior) {
+	//orient counter-clockwise:
+	float area = (v1_.x - v0.x) * (v2_.y - v0.y) - (v2_.x - v0.x) * (v1_.y - v0.y);
+	if (!(area != 0.0f)) return; //(also skips NaN)
+	ScreenVertex const &v1 = (area > 0.0f ? v1_ : v2_);
+	ScreenVertex const &v2 = (area > 0.0f ? v2_ : v1_);
+	bool interior_12 = (interior & 2) != 0;
+	bool interior_20 = (interior & (area > 0.0f ? 4 : 1)) != 0;
+	bool interior_01 = (interior & (area > 0.0f ? 1 : 4)) != 0;
+	area = std::abs(area);
+
+	//pixels whose centers (at +0.5) are inside the bounds:
+	int32_t x0 = std::max(int32_t(std::ceil(std::min(std::min(v0.x, v1.x), v2.x) - 0.5f)), 0);
+	int32_t x1 = std::min(int32_t(std::floor(std::max(std::max(v0.x, v1.x), v2.x) - 0.5f)), int32_t(width) - 1);
+	int32_t y0 = std::max(int32_t(std::ceil(std::min(std::min(v0.y, v1.y), v2.y) - 0.5f)), 0);
+	int32_t y1 = std::min(int32_t(std::floor(std::max(std::max(v0.y, v1.y), v2.y) - 0.5f)), int32_t(height) - 1);
+	if (x0 > x1 || y0 > y1) return;
+
+	//edge functions e = a * x + b * y + c, positive inside; edge i is opposite vertex i:
+	struct Edge {
+		float a, b, c;
+	};
+	auto make_edge = [](ScreenVertex const &from, ScreenVertex const &to, bool interior) {
+		Edge e;
+		e.a = from.y - to.y;
+		e.b = to.x - from.x;
+		e.c = -(e.a * from.x + e.b * from.y);
+		if (!interior) {
+			//a pixel center is this far inside the edge when its whole pixel is:
+			e.c -= 0.5f * (std::abs(e.a) + std::abs(e.b));
+		} else {
+			//(the triangle on the other side covers the rest of the pixel, so the pixel center decides;
+			// pushed out a bit so that rounding doesn't leave centers right on the edge in neither triangle)
+			e.c += (1.0f / 1024.0f) * (std::abs(e.a) + std::abs(e.b));
+		}
+		return e;
+	};
+	Edge e0 = make_edge(v1, v2, interior_12);
+	Edge e1 = make_edge(v2, v0, interior_20);
+	Edge e2 = make_edge(v0, v1, interior_01);
+
+	//1/w is linear in screen space; interpolate it as a plane, then step back to the pixel's farthest corner:
+	float za = (v0.inv_w * (v1.y - v2.y) + v1.inv_w * (v2.y - v0.y) + v2.inv_w * (v0.y - v1.y)) / area;
+	float zb = (v0.inv_w * (v2.x - v1.x) + v1.inv_w * (v0.x - v2.x) + v2.inv_w * (v1.x - v0.x)) / area;
+	float zc = v0.inv_w - za * v0.x - zb * v0.y - 0.5f * (std::abs(za) + std::abs(zb));
+
+	for (int32_t y = y0; y <= y1; ++y) {
+		float py = float(y) + 0.5f;
+		float *row = depth.data() + y * int32_t(width);
+		#ifdef OCCLUSION_SSE2
+		//four pixels at a time (rows are a multiple of four wide, so aligning x down stays in the buffer):
+		__m128 px_step = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		__m128 zero = _mm_setzero_ps();
+		__m128 e0_row = _mm_set1_ps(e0.b * py + e0.c);
+		__m128 e1_row = _mm_set1_ps(e1.b * py + e1.c);
+		__m128 e2_row = _mm_set1_ps(e2.b * py + e2.c);
+		__m128 z_row = _mm_set1_ps(zb * py + zc);
+		for (int32_t x4 = x0 & ~3; x4 <= x1; x4 += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps(float(x4)), px_step);
+			__m128 inside = _mm_and_ps(
+				_mm_and_ps(
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e0.a), px), e0_row), zero),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1.a), px), e1_row), zero)
+				),
+				_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2.a), px), e2_row), zero)
+			);
+			if (_mm_movemask_ps(inside) == 0) continue;
+			__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), z_row);
+			__m128 old = _mm_loadu_ps(row + x4);
+			__m128 nearer = _mm_and_ps(inside, _mm_cmpgt_ps(z, old));
+			_mm_storeu_ps(row + x4, _mm_or_ps(_mm_and_ps(nearer, z), _mm_andnot_ps(nearer, old)));
+		}
+		#else
+		for (int32_t x = x0; x <= x1; ++x) {
+			float px = float(x) + 0.5f;
+			if (e0.a * px + (e0.b * py + e0.c) < 0.0f) continue;
+			if (e1.a * px + (e1.b * py + e1.c) < 0.0f) continue;
+			if (e2.a * px + (e2.b * py + e2.c) < 0.0f) continue;
+			float z = za * px + (zb * py + zc);
+			if (z > row[x]) row[x] = z;
+		}
+		#endif
+	}
+}
+
+bool OcclusionBuffer::box_visible(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) const {
+	//screen bounds and nearest 1/w of the box's corners (w is linear, so the nearest point of the box is a corner):
+	float min_x = float(width), max_x = 0.0f;
+	float min_y = float(height), max_y = 0.0f;
+	float nearest = 0.0f;
+	for (uint32_t i = 0; i < 8; ++i) {
+		glm::vec4 clip = object_to_clip * glm::vec4(
+			(i & 1 ? max.x : min.x),
+			(i & 2 ? max.y : min.y),
+			(i & 4 ? max.z : min.z),
+			1.0f
+		);
+		if (!(clip.z + clip.w > 0.0f)) return true; //crosses the near plane (or is degenerate)
+		float inv_w = 1.0f / clip.w;
+		float x = (clip.x * inv_w * 0.5f + 0.5f) * float(width);
+		float y = (clip.y * inv_w * 0.5f + 0.5f) * float(height);
+		min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+		nearest = std::max(nearest, inv_w);
+	}
+
+	//pixels the box's bounds touch:
+	int32_t x0 = int32_t(std::max(std::floor(min_x), 0.0f));
+	int32_t x1 = int32_t(std::min(std::floor(max_x), float(width - 1)));
+	int32_t y0 = int32_t(std::max(std::floor(min_y), 0.0f));
+	int32_t y1 = int32_t(std::min(std::floor(max_y), float(height - 1)));
+	if (x0 > x1 || y0 > y1) return true; //(off screen -- leave that to frustum culling)
+
+	//hidden only if every pixel has an occluder strictly nearer than the box:
+	for (int32_t y = y0; y <= y1; ++y) {
+		float const *row = depth.data() + y * int32_t(width);
+		int32_t x = x0;
+		#ifdef OCCLUSION_SSE2
+		__m128 box = _mm_set1_ps(nearest);
+		for (; x + 3 <= x1; x += 4) {
+			if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(row + x), box)) != 0xf) return true;
+		}
+		#endif
+		for (; x <= x1; ++x) {
+			if (!(row[x] > nearest)) return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * OcclusionBuffer is a small CPU-side depth buffer for occlusion culling:
+ *  occluder triangles are rasterized into it (add_occluder()), then the
+ *  screen-space bounds of boxes are tested against it (box_visible()).
+ *
+ * The buffer is conservative: a pixel only counts as covered if the whole
+ *  pixel is inside an occluder, and it stores the farthest depth the
+ *  occluder has within the pixel -- so box_visible() never reports a box as
+ *  hidden unless it really is behind the occluders. Along edges shared by two
+ *  of an occluder's triangles, pixels go to the triangle that holds their
+ *  center (so the occluder has no cracks between its triangles); there, the
+ *  depth comes from that triangle's plane, which is exact for flat occluders.
+ *
+ * Everything runs on the calling thread with no OpenGL calls, and results
+ *  depend only on the inputs.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct OcclusionBuffer {
+	//'width' is rounded up to a multiple of four (pixels are processed four at a time):
+	OcclusionBuffer(uint32_t width = 256, uint32_t height = 128);
+
+	//forget all occluders:
+	void clear();
+
+	//rasterize triangles (three positions each, in object space) as seen through object_to_clip:
+	// (both sides of triangles occlude, so occluders don't need consistent winding)
+	void add_occluder(glm::mat4 const &object_to_clip, glm::vec3 const *positions, uint32_t count);
+
+	//could any part of the box [min,max] (in object space) be in front of the occluders?
+	// (boxes that cross the near plane are always visible)
+	bool box_visible(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) const;
+
+	uint32_t width, height;
+
+	//per pixel, row-major from the lower left: 1/w (clip w) of the nearest occluder, or 0 if nothing covers the pixel:
+	// (larger is nearer)
+	std::vector< float > depth;
+
+	//-- internals --
+	struct ScreenVertex {
+		float x, y; //pixel coordinates
+		float inv_w;
+	};
+	//'interior' has bits 1, 2, and 4 set for edges a-b, b-c, and c-a that are inside the occluder:
+	void rasterize(ScreenVertex const &a, ScreenVertex const &b, ScreenVertex const &c, uint32_t interior);
+
+	//scratch for add_occluder(), kept so adding occluders every frame doesn't allocate:
+	struct EdgeKey {
+		uint32_t bits[6]; //endpoint positions, as bits, in lexicographic order
+		uint32_t edge; //3 * triangle + edge (edge i goes from corner i to the next)
+	};
+	std::vector< EdgeKey > shared_edges;
+	std::vector< uint8_t > interior_edges; //per triangle: bit i set if edge i is shared with another triangle
+};
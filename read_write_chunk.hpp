@@ -4,6 +4,8 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <string>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -40,6 +42,86 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	}
 }
 
+//helper to check whether the next chunk in a stream has a given magic number (e.g., for optional chunks):
+// leaves the stream where it was; returns false at the end of the stream.
+inline bool next_chunk_is(std::istream &from, std::string const &magic) {
+	assert(magic.size() == 4);
+	std::streampos at = from.tellg();
+	char found[4] = {'\0', '\0', '\0', '\0'};
+	from.read(found, 4);
+	bool ret = (from.gcount() == 4 && std::string(found, 4) == magic);
+	from.clear();
+	from.seekg(at);
+	return ret;
+}
+
+//helper to read chunks in place from memory (e.g., a MappedFile):
+// chunks are not padded, so elements may be unaligned; they are copied out one at a time on access.
+template< typename T >
+struct ChunkView {
+	char const *data = nullptr;
+	size_t count = 0;
+
+	size_t size() const { return count; }
+	T operator[](size_t i) const {
+		assert(i < count);
+		T ret;
+		std::memcpy(&ret, data + i * sizeof(T), sizeof(T));
+		return ret;
+	}
+
+	struct iterator {
+		ChunkView const *view;
+		size_t i;
+		T operator*() const { return (*view)[i]; }
+		iterator &operator++() { ++i; return *this; }
+		bool operator!=(iterator const &o) const { return i != o.i; }
+	};
+	iterator begin() const { return iterator{this, 0}; }
+	iterator end() const { return iterator{this, count}; }
+};
+
+//same format as read_chunk, but reads from [*from_, end) and advances *from_ past the chunk:
+template< typename T >
+void view_chunk(char const **from_, char const *end, std::string const &magic, ChunkView< T > *to_) {
+	assert(from_);
+	assert(to_);
+	char const *&from = *from_;
+	auto &to = *to_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size_t(end - from) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, from, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+
+	if (size_t(end - from) - sizeof(header) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	to.data = from + sizeof(header);
+	to.count = header.size / sizeof(T);
+	from += sizeof(header) + header.size;
+}
+
+//same as next_chunk_is, for chunks in memory:
+inline bool next_chunk_is(char const *from, char const *end, std::string const &magic) {
+	assert(magic.size() == 4);
+	return size_t(end - from) >= 4 && std::memcmp(from, magic.data(), 4) == 0;
+}
 
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
@@ -0,0 +1,280 @@
+#include "render_commands.hpp"
+
+#include "Scene.hpp"
+#include "light_clusters.hpp"
+#include "gl_state.hpp"
+#include "gl_ring_buffer.hpp"
+#include "gl_errors.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+void RenderCommands::clear() {
+	commands.clear();
+	data.clear();
+	set_uniforms_fns.clear();
+	clusters_list.clear();
+	callbacks.clear();
+	wait = false;
+}
+
+uint32_t RenderCommands::push_data(void const *value, uint32_t size) {
+	uint32_t offset = uint32_t(data.size());
+	data.resize(offset + ((size + 15) & ~15U));
+	if (size) std::memcpy(data.data() + offset, value, size);
+	return offset;
+}
+
+uint32_t RenderCommands::push_clusters(LightClusters *clusters) {
+	for (uint32_t i = 0; i < clusters_list.size(); ++i) {
+		if (clusters_list[i] == clusters) return i;
+	}
+	clusters_list.emplace_back(clusters);
+	return uint32_t(clusters_list.size() - 1);
+}
+
+void RenderCommands::clear_buffers(GLbitfield mask, glm::vec4 const &color, float depth) {
+	glm::vec4 values[2] = { color, glm::vec4(depth, 0.0f, 0.0f, 0.0f) };
+	commands.emplace_back(Command{ Clear, mask, push_data(values, sizeof(values)), 0, 0, 0 });
+}
+
+void RenderCommands::enable(GLenum capability) {
+	commands.emplace_back(Command{ Enable, capability, 0, 0, 0, 0 });
+}
+
+void RenderCommands::disable(GLenum capability) {
+	commands.emplace_back(Command{ Disable, capability, 0, 0, 0, 0 });
+}
+
+void RenderCommands::depth_func(GLenum func) {
+	commands.emplace_back(Command{ DepthFunc, func, 0, 0, 0, 0 });
+}
+
+void RenderCommands::use_program(GLuint program) {
+	commands.emplace_back(Command{ UseProgram, program, 0, 0, 0, 0 });
+}
+
+void RenderCommands::bind_vertex_array(GLuint vao) {
+	commands.emplace_back(Command{ BindVertexArray, vao, 0, 0, 0, 0 });
+}
+
+void RenderCommands::bind_texture(uint32_t unit, GLenum target, GLuint texture) {
+	commands.emplace_back(Command{ BindTexture, unit, target, texture, 0, 0 });
+}
+
+void RenderCommands::unbind_textures(uint32_t unit) {
+	commands.emplace_back(Command{ UnbindTextures, unit, 0, 0, 0, 0 });
+}
+
+void RenderCommands::uniform_block(GLuint binding, void const *block, uint32_t size) {
+	commands.emplace_back(Command{ UniformBlock, binding, push_data(block, size), size, 0, 0 });
+}
+
+void RenderCommands::uniform(GLuint location, glm::mat4 const &value) {
+	commands.emplace_back(Command{ UniformMat4, location, push_data(&value, sizeof(value)), 0, 0, 0 });
+}
+
+void RenderCommands::uniform(GLuint location, glm::mat4x3 const &value) {
+	commands.emplace_back(Command{ UniformMat4x3, location, push_data(&value, sizeof(value)), 0, 0, 0 });
+}
+
+void RenderCommands::uniform(GLuint location, glm::mat3 const &value) {
+	commands.emplace_back(Command{ UniformMat3, location, push_data(&value, sizeof(value)), 0, 0, 0 });
+}
+
+void RenderCommands::set_uniforms(std::function< void() > const *fn) {
+	assert(fn && *fn);
+	set_uniforms_fns.emplace_back(fn);
+	commands.emplace_back(Command{ SetUniforms, uint32_t(set_uniforms_fns.size() - 1), 0, 0, 0, 0 });
+}
+
+void RenderCommands::instances(void const *instance_data, uint32_t size) {
+	commands.emplace_back(Command{ Instances, 0, push_data(instance_data, size), size, 0, 0 });
+}
+
+void RenderCommands::draw_arrays(GLenum type, GLuint first, GLuint count) {
+	commands.emplace_back(Command{ DrawArrays, type, first, count, 0, 0 });
+}
+
+void RenderCommands::draw_arrays_instanced(GLenum type, GLuint first, GLuint count, GLuint instance_count) {
+	commands.emplace_back(Command{ DrawArraysInstanced, type, first, count, instance_count, 0 });
+}
+
+void RenderCommands::draw_elements(GLenum type, GLenum index_type, GLuint first, GLuint count, GLuint base_vertex) {
+	assert(type <= 0xffff && index_type <= 0xffff);
+	commands.emplace_back(Command{ DrawElements, type | (index_type << 16), first, count, base_vertex, 0 });
+}
+
+void RenderCommands::draw_elements_instanced(GLenum type, GLenum index_type, GLuint first, GLuint count, GLuint base_vertex, GLuint instance_count) {
+	assert(type <= 0xffff && index_type <= 0xffff);
+	commands.emplace_back(Command{ DrawElementsInstanced, type | (index_type << 16), first, count, base_vertex, instance_count });
+}
+
+void RenderCommands::multi_draw_elements(GLenum type, GLenum index_type, glm::uvec2 const *ranges, uint32_t range_count, GLuint base_vertex) {
+	assert(type <= 0xffff && index_type <= 0xffff);
+	assert(ranges || range_count == 0);
+	commands.emplace_back(Command{ MultiDrawElements, type | (index_type << 16), push_data(ranges, range_count * uint32_t(sizeof(glm::uvec2))), range_count, base_vertex, 0 });
+}
+
+void RenderCommands::upload_clusters(LightClusters *clusters) {
+	assert(clusters);
+	assert(clusters->clusters.size() == LightClusters::Count);
+	//lights, then clusters, then indices, each 16-byte aligned:
+	uint32_t offset = push_data(clusters->lights.data(), uint32_t(clusters->lights.size() * sizeof(LightClusters::Light)));
+	push_data(clusters->clusters.data(), uint32_t(clusters->clusters.size() * sizeof(glm::uvec2)));
+	push_data(clusters->indices.data(), uint32_t(clusters->indices.size() * sizeof(uint32_t)));
+	commands.emplace_back(Command{ UploadClusters, push_clusters(clusters), offset, uint32_t(clusters->lights.size()), uint32_t(clusters->indices.size()), 0 });
+}
+
+void RenderCommands::bind_clusters(LightClusters const *clusters) {
+	assert(clusters);
+	commands.emplace_back(Command{ BindClusters, push_clusters(const_cast< LightClusters * >(clusters)), 0, 0, 0, 0 });
+}
+
+void RenderCommands::callback(std::function< void() > const &fn) {
+	callbacks.emplace_back(fn);
+	commands.emplace_back(Command{ Callback, uint32_t(callbacks.size() - 1), 0, 0, 0, 0 });
+}
+
+void RenderCommands::execute() const {
+	//Write all uniform blocks in one pass through one mapped range:
+	block_offsets.clear();
+	for (auto const &command : commands) {
+		if (command.op == UniformBlock) block_offsets.emplace_back(0);
+	}
+	GLRingBuffer *ring = nullptr;
+	if (!block_offsets.empty()) {
+		//(n.b. never deleted, like Load<> data, since it must not outlive the GL context)
+		static GLRingBuffer *uniforms_ring = new GLRingBuffer(GL_UNIFORM_BUFFER);
+		ring = uniforms_ring;
+
+		//(blocks are placed at the ring's alignment, which is at least GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)
+		GLsizeiptr alignment = ring->alignment;
+		auto align = [alignment](GLsizeiptr size) {
+			return (size + alignment - 1) / alignment * alignment;
+		};
+
+		GLsizeiptr total = 0;
+		uint32_t block = 0;
+		for (auto const &command : commands) {
+			if (command.op != UniformBlock) continue;
+			block_offsets[block++] = total;
+			total += align(command.c);
+		}
+
+		GLintptr base = 0;
+		char *mapped = reinterpret_cast< char * >(ring->map(total, &base));
+		block = 0;
+		for (auto const &command : commands) {
+			if (command.op != UniformBlock) continue;
+			std::memcpy(mapped + block_offsets[block], data.data() + command.b, command.c);
+			block_offsets[block] += base;
+			++block;
+		}
+		ring->unmap();
+	}
+
+	uint32_t block = 0;
+	for (auto const &command : commands) {
+		switch (command.op) {
+			case Clear: {
+				float const *values = reinterpret_cast< float const * >(data.data() + command.b);
+				if (command.a & GL_COLOR_BUFFER_BIT) glClearColor(values[0], values[1], values[2], values[3]);
+				if (command.a & GL_DEPTH_BUFFER_BIT) glClearDepth(values[4]);
+				glClear(command.a);
+			} break;
+			case Enable:
+				glEnable(command.a);
+				break;
+			case Disable:
+				glDisable(command.a);
+				break;
+			case DepthFunc:
+				glDepthFunc(command.a);
+				break;
+			case UseProgram:
+				gl_state.use_program(command.a);
+				break;
+			case BindVertexArray:
+				gl_state.bind_vertex_array(command.a);
+				break;
+			case BindTexture:
+				gl_state.bind_texture(command.a, command.b, command.c);
+				break;
+			case UnbindTextures:
+				gl_state.unbind_textures(command.a);
+				break;
+			case UniformBlock:
+				gl_state.bind_uniform_buffer_range(command.a, ring->buffer, block_offsets[block++], command.c);
+				break;
+			case UniformMat4:
+				glUniformMatrix4fv(command.a, 1, GL_FALSE, reinterpret_cast< float const * >(data.data() + command.b));
+				break;
+			case UniformMat4x3:
+				glUniformMatrix4x3fv(command.a, 1, GL_FALSE, reinterpret_cast< float const * >(data.data() + command.b));
+				break;
+			case UniformMat3:
+				glUniformMatrix3fv(command.a, 1, GL_FALSE, reinterpret_cast< float const * >(data.data() + command.b));
+				break;
+			case SetUniforms:
+				(*set_uniforms_fns[command.a])();
+				break;
+			case Instances:
+				gl_state.bind_buffer(GL_ARRAY_BUFFER, Scene::instance_buffer());
+				glBufferData(GL_ARRAY_BUFFER, command.c, data.data() + command.b, GL_STREAM_DRAW); //(n.b. orphans the previous contents)
+				break;
+			case DrawArrays:
+				glDrawArrays(command.a, command.b, command.c);
+				break;
+			case DrawArraysInstanced:
+				glDrawArraysInstanced(command.a, command.b, command.c, command.d);
+				break;
+			case DrawElements:
+			case DrawElementsInstanced: {
+				GLenum index_type = command.a >> 16;
+				GLbyte const *first = (GLbyte const *)0 + command.b * (index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+				if (command.op == DrawElements) {
+					glDrawElementsBaseVertex(command.a & 0xffff, command.c, index_type, first, command.d);
+				} else {
+					glDrawElementsInstancedBaseVertex(command.a & 0xffff, command.c, index_type, first, command.e, command.d);
+				}
+			} break;
+			case MultiDrawElements: {
+				GLenum index_type = command.a >> 16;
+				GLsizeiptr index_size = (index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+				glm::uvec2 const *ranges = reinterpret_cast< glm::uvec2 const * >(data.data() + command.b);
+				multi_counts.resize(command.c);
+				multi_firsts.resize(command.c);
+				multi_base_vertices.assign(command.c, GLint(command.d));
+				for (uint32_t i = 0; i < command.c; ++i) {
+					multi_firsts[i] = (GLbyte const *)0 + ranges[i].x * index_size;
+					multi_counts[i] = GLsizei(ranges[i].y);
+				}
+				glMultiDrawElementsBaseVertex(command.a & 0xffff, multi_counts.data(), index_type, multi_firsts.data(), GLsizei(command.c), multi_base_vertices.data());
+			} break;
+			case UploadClusters: {
+				char const *at = data.data() + command.b;
+				auto advance = [&at](size_t size) {
+					char const *ret = at;
+					at += (size + 15) & ~size_t(15);
+					return ret;
+				};
+				auto const *lights = reinterpret_cast< LightClusters::Light const * >(advance(command.c * sizeof(LightClusters::Light)));
+				auto const *clusters = reinterpret_cast< glm::uvec2 const * >(advance(LightClusters::Count * sizeof(glm::uvec2)));
+				auto const *indices = reinterpret_cast< uint32_t const * >(advance(command.d * sizeof(uint32_t)));
+				clusters_list[command.a]->upload(lights, command.c, clusters, indices, command.d);
+			} break;
+			case BindClusters:
+				clusters_list[command.a]->bind();
+				break;
+			case Callback:
+				callbacks[command.a]();
+				break;
+		}
+	}
+
+	GL_ERRORS();
+}
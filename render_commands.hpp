@@ -0,0 +1,115 @@
+#pragma once
+
+/*
+ * RenderCommands is a recorded list of OpenGL work: recording (e.g., with
+ *  Scene::record()) makes no OpenGL calls, and execute() replays the list
+ *  on whichever thread has the OpenGL context (see gl_thread.hpp).
+ *
+ * Snapshot rules -- what a list may refer to once recorded:
+ *  - matrices, uniform block contents, instance data, and light cluster data
+ *    are copied into the list, so transforms and lights may change right away;
+ *  - OpenGL objects (programs, vertex arrays, textures), Pipeline::set_uniforms
+ *    functions, and LightClusters whose data is uploaded or bound are referred
+ *    to, and must stay valid (and, for set_uniforms, safe to call) until the
+ *    list has been executed.
+ *
+ * clear() keeps the list's storage, so re-recording a similar frame into the
+ *  same list doesn't allocate (except for callbacks, which are std::functions).
+ *
+ */
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct LightClusters;
+
+struct RenderCommands {
+	enum Op : uint32_t {
+		Clear, //a: mask, b: offset of vec4 color + float depth in 'data'
+		Enable, //a: capability
+		Disable, //a: capability
+		DepthFunc, //a: function
+		UseProgram, //a: program
+		BindVertexArray, //a: vertex array
+		BindTexture, //a: unit, b: target, c: texture
+		UnbindTextures, //a: unit
+		UniformBlock, //a: binding point, b: offset in 'data', c: size
+		UniformMat4, //a: location, b: offset of matrix in 'data'
+		UniformMat4x3, //a: location, b: offset of matrix in 'data'
+		UniformMat3, //a: location, b: offset of matrix in 'data'
+		SetUniforms, //a: index in 'set_uniforms'
+		Instances, //b: offset in 'data', c: size -- copied to Scene::instance_buffer()
+		DrawArrays, //a: type, b: first, c: count
+		DrawArraysInstanced, //a: type, b: first, c: count, d: instances
+		DrawElements, //a: type | index type << 16, b: first index, c: count, d: base vertex
+		DrawElementsInstanced, //a: type | index type << 16, b: first index, c: count, d: base vertex, e: instances
+		MultiDrawElements, //a: type | index type << 16, b: offset of (first index, count) pairs in 'data', c: pairs, d: base vertex
+		UploadClusters, //a: index in 'clusters', b: offset in 'data', c: lights, d: indices
+		BindClusters, //a: index in 'clusters'
+		Callback, //a: index in 'callbacks'
+	};
+	struct Command {
+		Op op;
+		uint32_t a, b, c, d, e;
+	};
+	static_assert(sizeof(Command) == 24, "Command is packed.");
+
+	//viewport the commands will run with (set by whoever records; used, e.g., to place light cluster tiles):
+	glm::ivec4 viewport = glm::ivec4(0);
+
+	//if set, whoever replays the list should let the recording thread know when it is done,
+	// since the list refers to state that it mustn't change before then (see Mode::record):
+	bool wait = false;
+
+	//forget all commands (keeping storage):
+	void clear();
+
+	//record commands:
+	void clear_buffers(GLbitfield mask, glm::vec4 const &color = glm::vec4(0.0f), float depth = 1.0f);
+	void enable(GLenum capability);
+	void disable(GLenum capability);
+	void depth_func(GLenum func);
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint vao);
+	void bind_texture(uint32_t unit, GLenum target, GLuint texture);
+	void unbind_textures(uint32_t unit);
+	void uniform_block(GLuint binding, void const *block, uint32_t size); //(block contents are copied)
+	void uniform(GLuint location, glm::mat4 const &value);
+	void uniform(GLuint location, glm::mat4x3 const &value);
+	void uniform(GLuint location, glm::mat3 const &value);
+	void set_uniforms(std::function< void() > const *fn); //(calls *fn when executed)
+	void instances(void const *instance_data, uint32_t size); //(data is copied)
+	void draw_arrays(GLenum type, GLuint first, GLuint count);
+	void draw_arrays_instanced(GLenum type, GLuint first, GLuint count, GLuint instance_count);
+	//(indexed draws read the element array buffer of the bound vertex array; 'first' counts indices)
+	void draw_elements(GLenum type, GLenum index_type, GLuint first, GLuint count, GLuint base_vertex);
+	void draw_elements_instanced(GLenum type, GLenum index_type, GLuint first, GLuint count, GLuint base_vertex, GLuint instance_count);
+	void multi_draw_elements(GLenum type, GLenum index_type, glm::uvec2 const *ranges, uint32_t range_count, GLuint base_vertex); //(ranges are (first, count) pairs; copied)
+	void upload_clusters(LightClusters *clusters); //(copies clusters' current build() results)
+	void bind_clusters(LightClusters const *clusters);
+	void callback(std::function< void() > const &fn);
+
+	//make the recorded OpenGL calls (all bindings go through gl_state):
+	// (uniform blocks are written through one mapped range of a GLRingBuffer first)
+	void execute() const;
+
+	//-- internals --
+	std::vector< Command > commands;
+	std::vector< char > data; //copied values, each 16-byte aligned
+	std::vector< std::function< void() > const * > set_uniforms_fns;
+	std::vector< LightClusters * > clusters_list; //(const_cast from bind_clusters() too; only bind() is called on those)
+	std::vector< std::function< void() > > callbacks;
+	mutable std::vector< GLintptr > block_offsets; //scratch for execute(): where each UniformBlock ended up
+	//scratch for execute(): MultiDrawElements arguments:
+	mutable std::vector< GLsizei > multi_counts;
+	mutable std::vector< void const * > multi_firsts;
+	mutable std::vector< GLint > multi_base_vertices;
+
+	uint32_t push_data(void const *value, uint32_t size); //returns offset in 'data'
+	uint32_t push_clusters(LightClusters *clusters); //returns index in 'clusters_list'
+};
@@ -97,6 +97,15 @@ strings = b''
 #index gives offsets into the data (and names) for each mesh:
 index = b''
 
+#ranges gives offsets into the elements for each mesh:
+ranges = b''
+
+#bounds are the min and max corners of each mesh's positions:
+bounds = b''
+
+#elements are the indices (relative to the mesh's first vertex) of each triangle's vertices:
+elements = []
+
 vertex_count = 0
 for obj in bpy.data.objects:
 	if obj.data in to_write:
@@ -159,39 +168,52 @@ for obj in bpy.data.objects:
 		if len(obj.data.uv_layers) != 1:
 			print("WARNING: object '" + name + "' has multiple texture coordinate layers; only exporting '" + obj.data.uv_layers.active.name + "'")
 
-	local_data = b''
-
-	#write the mesh triangles:
+	#write the mesh's distinct vertices, and the triangles as indices into them:
+	local_index = dict() #vertex data -> index of vertex in this mesh
+	lo = [float('inf')] * 3
+	hi = [float('-inf')] * 3
+	elements_begin = len(elements)
 	for poly in mesh.polygons:
 		assert(len(poly.loop_indices) == 3)
 		for i in range(0,3):
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
 			loop = mesh.loops[poly.loop_indices[i]]
 			vertex = mesh.vertices[loop.vertex_index]
-			for x in vertex.co:
-				local_data += struct.pack('f', x)
+			vertex_data = b''
+			for c, x in enumerate(vertex.co):
+				vertex_data += struct.pack('f', x)
+				lo[c] = min(lo[c], x)
+				hi[c] = max(hi[c], x)
 			for x in loop.normal:
-				local_data += struct.pack('f', x)
+				vertex_data += struct.pack('f', x)
 			if colors != None:
 				col = colors[poly.loop_indices[i]].color
-				local_data += struct.pack('BBBB', int(col[0] * 255), int(col[1] * 255), int(col[2] * 255), 255)
+				vertex_data += struct.pack('BBBB', int(col[0] * 255), int(col[1] * 255), int(col[2] * 255), 255)
 			else:
-				local_data += struct.pack('BBBB', 255, 255, 255, 255)
+				vertex_data += struct.pack('BBBB', 255, 255, 255, 255)
 			if uvs != None:
 				uv = uvs[poly.loop_indices[i]].uv
-				local_data += struct.pack('ff', uv.x, uv.y)
+				vertex_data += struct.pack('ff', uv.x, uv.y)
 			else:
-				local_data += struct.pack('ff', 0, 0)
-		if len(local_data) > 1000:
-			data.append(local_data)
-			local_data = b''
-	vertex_count += len(mesh.polygons) * 3
-
-	data.append(local_data)
+				vertex_data += struct.pack('ff', 0, 0)
+			if not vertex_data in local_index:
+				local_index[vertex_data] = len(local_index)
+				data.append(vertex_data)
+			elements.append(local_index[vertex_data])
+	vertex_count += len(local_index)
 
 	index += struct.pack('I', vertex_count) #vertex_end
 
+	ranges += struct.pack('I', elements_begin) #index_begin
+	ranges += struct.pack('I', len(elements)) #index_end
+
+	bounds += struct.pack('fff', *lo) #min
+	bounds += struct.pack('fff', *hi) #max
+
+	print("  " + str(len(elements) - elements_begin) + " indices into " + str(len(local_index)) + " distinct vertices.")
+
 data = b''.join(data)
+elements = struct.pack(str(len(elements)) + 'I', *elements)
 
 #check that code created as much data as anticipated:
 assert(vertex_count * (4*3+4*3+1*4+4*2) == len(data))
@@ -210,7 +232,19 @@ blob.write(strings)
 blob.write(struct.pack('4s',b'idx0')) #type
 blob.write(struct.pack('I', len(index))) #length
 blob.write(index)
+#fourth chunk: the index ranges
+blob.write(struct.pack('4s',b'idx1')) #type
+blob.write(struct.pack('I', len(ranges))) #length
+blob.write(ranges)
+#fifth chunk: the indices
+blob.write(struct.pack('4s',b'ind0')) #type
+blob.write(struct.pack('I', len(elements))) #length
+blob.write(elements)
+#sixth chunk: the bounds (so loading doesn't have to read every vertex)
+blob.write(struct.pack('4s',b'bnd0')) #type
+blob.write(struct.pack('I', len(bounds))) #length
+blob.write(bounds)
 wrote = blob.tell()
 blob.close()
 
-print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index + " + str(len(ranges)+8) + " bytes of index ranges + " + str(len(elements)+8) + " bytes of indices + " + str(len(bounds)+8) + " bytes of bounds] to '" + outfile + "'")
@@ -2,6 +2,7 @@
 #include "ShowMeshesMode.hpp"
 #include "Load.hpp"
 #include "GL.hpp"
+#include "gl_state.hpp"
 #include "load_save_png.hpp"
 
 #include <SDL.h>
@@ -83,7 +84,7 @@ int main(int argc, char **argv) {
 	MeshBuffer *buffer = nullptr;
 	if (argc == 2) {
 		try {
-			buffer = new MeshBuffer(argv[1]);
+			buffer = new MeshBuffer(argv[1], true, false); //(only draws, so no CPU copy of the vertices needed)
 		} catch (std::exception &e) {
 			std::cerr << "ERROR: " << e.what() << std::endl;
 			usage = true;
@@ -170,7 +171,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			gl_state.new_frame(); //(resets per-frame GL call counters)
 			Mode::current->draw(drawable_size);
 		}
 
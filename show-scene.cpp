@@ -2,6 +2,7 @@
 #include "ShowSceneMode.hpp"
 #include "Load.hpp"
 #include "GL.hpp"
+#include "gl_state.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
 
@@ -95,7 +96,7 @@ int main(int argc, char **argv) {
 	GLuint buffer_vao = 0;
 	if (meshes_file != "") {
 		try {
-			buffer = new MeshBuffer(meshes_file);
+			buffer = new MeshBuffer(meshes_file, true, false); //(only draws, so no CPU copy of the vertices needed)
 			buffer_vao = buffer->make_vao_for_program(show_scene_program->program);
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading mesh buffer '" << meshes_file << "': " << e.what() << std::endl;
@@ -120,6 +121,15 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.base_vertex = mesh.vertex_start;
+				drawable.pipeline.position_scale = mesh.position_scale;
+				drawable.pipeline.position_offset = mesh.position_offset;
+
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
+				drawable.clusters = buffer->clusters.data() + mesh.cluster_start;
+				drawable.cluster_count = mesh.cluster_count;
 
 			});
 		} catch (std::exception &e) {
@@ -212,7 +222,7 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			gl_state.new_frame(); //(resets per-frame GL call counters)
 			Mode::current->draw(drawable_size);
 		}
 
@@ -0,0 +1,66 @@
+/*
+ * test-occlusion-buffer checks OcclusionBuffer (see occlusion_buffer.hpp)
+ *  against a few simple scenes, with no OpenGL (or window) needed.
+ *
+ * The camera sits at the origin looking down -z; the occluder is a 4x4 quad
+ *  facing it, five units away. Exits with an error if any check fails.
+ *
+ * Usage:
+ *   test-occlusion-buffer
+ *
+ */
+
+#include "occlusion_buffer.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main() {
+	uint32_t failed = 0;
+	auto check = [&failed](bool ok, std::string const &what) {
+		std::cout << (ok ? "  ok: " : "  FAILED: ") << what << std::endl;
+		if (!ok) failed += 1;
+	};
+
+	glm::mat4 world_to_clip = glm::infinitePerspective(glm::radians(60.0f), 2.0f, 0.1f);
+
+	//two triangles (wound differently, since both sides occlude):
+	std::vector< glm::vec3 > quad{
+		glm::vec3(-2.0f,-2.0f,-5.0f), glm::vec3( 2.0f,-2.0f,-5.0f), glm::vec3( 2.0f, 2.0f,-5.0f),
+		glm::vec3(-2.0f,-2.0f,-5.0f), glm::vec3(-2.0f, 2.0f,-5.0f), glm::vec3( 2.0f, 2.0f,-5.0f),
+	};
+
+	OcclusionBuffer buffer;
+
+	std::cout << "Without occluders:" << std::endl;
+	check(buffer.box_visible(world_to_clip, glm::vec3(-0.5f,-0.5f,-10.0f), glm::vec3(0.5f, 0.5f,-9.0f)), "box is visible");
+
+	buffer.add_occluder(world_to_clip, quad.data(), uint32_t(quad.size()));
+
+	std::cout << "With a quad occluder:" << std::endl;
+	check(!buffer.box_visible(world_to_clip, glm::vec3(-0.5f,-0.5f,-10.0f), glm::vec3(0.5f, 0.5f,-9.0f)), "box behind the quad is hidden");
+	check(buffer.box_visible(world_to_clip, glm::vec3( 6.0f,-0.5f,-10.0f), glm::vec3(7.0f, 0.5f,-9.0f)), "box beside the quad is visible");
+	check(buffer.box_visible(world_to_clip, glm::vec3(-0.5f,-0.5f,-3.0f), glm::vec3(0.5f, 0.5f,-2.0f)), "box in front of the quad is visible");
+	check(buffer.box_visible(world_to_clip, glm::vec3(-5.0f,-0.5f,-10.0f), glm::vec3(5.0f, 0.5f,-9.0f)), "box sticking out from behind the quad is visible");
+	check(buffer.box_visible(world_to_clip, glm::vec3(-0.5f,-0.5f,-10.0f), glm::vec3(0.5f, 0.5f, 1.0f)), "box straddling the near plane is visible");
+	check(buffer.box_visible(world_to_clip, glm::vec3(-0.5f,-0.5f,-5.5f), glm::vec3(0.5f, 0.5f,-4.5f)), "box cut by the quad is visible");
+
+	//the same occluders (in the same order) should always give the same buffer:
+	OcclusionBuffer again;
+	again.add_occluder(world_to_clip, quad.data(), uint32_t(quad.size()));
+	check(again.depth == buffer.depth, "rasterizing again gives the same depths");
+
+	//...and clear() should forget them:
+	buffer.clear();
+	check(buffer.box_visible(world_to_clip, glm::vec3(-0.5f,-0.5f,-10.0f), glm::vec3(0.5f, 0.5f,-9.0f)), "box is visible after clear()");
+
+	if (failed) {
+		std::cerr << failed << " check(s) failed." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}